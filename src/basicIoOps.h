@@ -110,6 +110,7 @@ typedef union {
 	char	c[sizeof(int)];
 } __EndianTestU;
 
+typedef uint64_t __TillsIoOps64_t;
 typedef uint32_t __TillsIoOps32_t;
 typedef uint16_t __TillsIoOps16_t;
 
@@ -139,8 +140,13 @@ __endian_test_is_little(void)
 const __EndianTestU u = {(int)1};
 	return u.c[0];
 }
+/* newer gcc (>= 4.6) and clang tell us; no probing needed */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#define ENDIAN_TEST_IS_LITTLE	(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#else
 #define ENDIAN_TEST_IS_LITTLE	__endian_test_is_little()
 #endif
+#endif
 
 #else /* not gcc */
 
@@ -166,13 +172,58 @@ static const __EndianTestU endianTester={(int)1};
 #endif
 #endif
 
+/* I/O barriers
+ *
+ * Every accessor is followed by a barrier which orders it with
+ * respect to subsequent accesses (to I/O or to memory). The
+ * *_relaxed() variants omit it; a driver issuing a burst of
+ * accesses may use those and order them as a whole by one
+ * explicit barrier:
+ *
+ *   iobarrier_r()    - preceding reads
+ *   iobarrier_w()    - preceding writes
+ *   iobarrier_rw()   - both
+ *   iobarrier_sync() - wait until preceding accesses are complete
+ *                      (e.g., before a delay loop)
+ *
+ * NOTE: A write which makes a device look at data in memory
+ *       (e.g., a DMA 'doorbell') must be preceded by an
+ *       iobarrier_w() issued after the data were stored.
+ */
 #if defined(ASSEMBLEPPC)
 #define __eieio()	do { __asm__ __volatile__ ("eieio"); } while(0)
 #define iobarrier_r()	__eieio()
 #define iobarrier_rw()	__eieio()
 #define iobarrier_w()	__eieio()
-#elif defined(__i386__) || defined(__i386) || defined(__sparc__) || defined(__sparc)
-/* nothing to do on __i386__ */
+#define iobarrier_sync()	do { __asm__ __volatile__ ("sync":::"memory"); } while(0)
+#elif defined(__x86_64__) || defined(__i386__) || defined(__i386)
+/* The CPU doesn't reorder uncached accesses; just keep the
+ * compiler from moving memory accesses across the barrier.
+ * (Write-combining mappings need an 'sfence' which is not
+ * provided here.)
+ */
+#define __iocbarrier()	do { __asm__ __volatile__ ("":::"memory"); } while(0)
+#define iobarrier_r()	__iocbarrier()
+#define iobarrier_rw()	__iocbarrier()
+#define iobarrier_w()	__iocbarrier()
+#if defined(__x86_64__) || defined(__SSE2__)
+#define iobarrier_sync()	do { __asm__ __volatile__ ("mfence":::"memory"); } while(0)
+#endif
+#elif defined(__aarch64__)
+/* device accesses are ordered per peripheral; the barriers
+ * (outer shareable domain) order them with memory, too.
+ */
+#define iobarrier_r()	do { __asm__ __volatile__ ("dmb oshld":::"memory"); } while(0)
+#define iobarrier_rw()	do { __asm__ __volatile__ ("dmb osh":::"memory"); } while(0)
+#define iobarrier_w()	do { __asm__ __volatile__ ("dmb oshst":::"memory"); } while(0)
+#define iobarrier_sync()	do { __asm__ __volatile__ ("dsb sy":::"memory"); } while(0)
+#elif defined(__arm__) && defined(__ARM_ARCH) && (__ARM_ARCH >= 7)
+#define iobarrier_r()	do { __asm__ __volatile__ ("dmb osh":::"memory"); } while(0)
+#define iobarrier_rw()	do { __asm__ __volatile__ ("dmb osh":::"memory"); } while(0)
+#define iobarrier_w()	do { __asm__ __volatile__ ("dmb oshst":::"memory"); } while(0)
+#define iobarrier_sync()	do { __asm__ __volatile__ ("dsb sy":::"memory"); } while(0)
+#elif defined(__sparc__) || defined(__sparc)
+/* nothing to do on __sparc__ */
 #else
 #warning "Unknown IO barrier/synchronization for this CPU (add an #ifdef <YourCpu> around this warning if none needed by your CPU)"
 #endif
@@ -186,11 +237,37 @@ static const __EndianTestU endianTester={(int)1};
 #ifndef iobarrier_w
 #define iobarrier_w() do{}while(0)
 #endif
+#ifndef iobarrier_sync
+#define iobarrier_sync() iobarrier_rw()
+#endif
+
+/* byte swaps (gcc recognizes these) */
+static _INLINE_ __TillsIoOps16_t
+__iobswap16(__TillsIoOps16_t v)
+{
+	return (v<<8) | (v>>8);
+}
 
 static _INLINE_ __TillsIoOps32_t
-in_le32(volatile __TillsIoOps32_t *pval)
+__iobswap32(__TillsIoOps32_t v)
 {
-register __TillsIoOps32_t rval;
+	return (((v & 0xff000000) >> 24) |
+	        ((v & 0x00ff0000) >>  8) |
+	        ((v & 0x0000ff00) <<  8) |
+	        ((v & 0x000000ff) << 24));
+}
+
+static _INLINE_ __TillsIoOps64_t
+__iobswap64(__TillsIoOps64_t v)
+{
+	return ((__TillsIoOps64_t)__iobswap32((__TillsIoOps32_t)v) << 32) | __iobswap32((__TillsIoOps32_t)(v >> 32));
+}
+
+/* Accessors w/o barrier (see above) */
+static _INLINE_ __TillsIoOps32_t
+in_le32_relaxed(volatile __TillsIoOps32_t *pval)
+{
+__TillsIoOps32_t rval;
 	if (ENDIAN_TEST_IS_LITTLE) {
 			rval = *pval;
 	} else {
@@ -207,22 +284,20 @@ register __TillsIoOps32_t rval;
 		}
 #endif
 	}
-	iobarrier_r();
 	return rval;
 }
 
 static _INLINE_ __TillsIoOps32_t
-in_be32(volatile __TillsIoOps32_t *pval)
+in_be32_relaxed(volatile __TillsIoOps32_t *pval)
 {
-register __TillsIoOps32_t rval=*pval;
-	iobarrier_r();
+__TillsIoOps32_t rval=*pval;
 	return ntohl(rval);
 }
 
 static _INLINE_ __TillsIoOps16_t
-in_le16(volatile __TillsIoOps16_t *pval)
+in_le16_relaxed(volatile __TillsIoOps16_t *pval)
 {
-register __TillsIoOps16_t rval;
+__TillsIoOps16_t rval;
 	if (ENDIAN_TEST_IS_LITTLE) {
 		rval = *pval;
 	} else {
@@ -239,30 +314,25 @@ register __TillsIoOps16_t rval;
 		}
 #endif
 	}
-	iobarrier_r();
 	return rval;
 }
 
 static _INLINE_ __TillsIoOps16_t
-in_be16(volatile __TillsIoOps16_t *pval)
+in_be16_relaxed(volatile __TillsIoOps16_t *pval)
 {
-register __TillsIoOps16_t rval=*pval;
-	iobarrier_r();
+__TillsIoOps16_t rval=*pval;
 	return ntohs(rval);
 }
 
 
 static _INLINE_ unsigned char
-in_8(volatile unsigned char *pval)
+in_8_relaxed(volatile unsigned char *pval)
 {
-register unsigned char rval=*pval;
-	iobarrier_r();
-	return rval;
-	
+	return *pval;
 }
 
 static _INLINE_ void
-out_le32(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
+out_le32_relaxed(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
 {
 	if (ENDIAN_TEST_IS_LITTLE) {
 		*addr=val;
@@ -283,18 +353,16 @@ out_le32(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
 		}
 #endif
 	}
-	iobarrier_w();
 }
 
 static _INLINE_ void
-out_be32(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
+out_be32_relaxed(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
 {
 	*addr = htonl(val);
-	iobarrier_w();
 }
 
 static _INLINE_ void
-out_le16(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
+out_le16_relaxed(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
 {
 	if (ENDIAN_TEST_IS_LITTLE) {
 		*addr=val;
@@ -311,20 +379,573 @@ out_le16(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
 		}
 #endif
 	}
+}
+
+static _INLINE_ void
+out_be16_relaxed(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
+{
+	*addr = htons(val);
+}
+
+static _INLINE_ void
+out_8_relaxed(volatile unsigned char *addr, unsigned char val)
+{
+	*addr=val;
+}
+
+/* ... and with barrier */
+
+static _INLINE_ __TillsIoOps32_t
+in_le32(volatile __TillsIoOps32_t *pval)
+{
+__TillsIoOps32_t rval = in_le32_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ __TillsIoOps32_t
+in_be32(volatile __TillsIoOps32_t *pval)
+{
+__TillsIoOps32_t rval = in_be32_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ __TillsIoOps16_t
+in_le16(volatile __TillsIoOps16_t *pval)
+{
+__TillsIoOps16_t rval = in_le16_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ __TillsIoOps16_t
+in_be16(volatile __TillsIoOps16_t *pval)
+{
+__TillsIoOps16_t rval = in_be16_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ unsigned char
+in_8(volatile unsigned char *pval)
+{
+unsigned char rval = in_8_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ void
+out_le32(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
+{
+	out_le32_relaxed(addr, val);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_be32(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t val)
+{
+	out_be32_relaxed(addr, val);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_le16(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
+{
+	out_le16_relaxed(addr, val);
 	iobarrier_w();
 }
 
 static _INLINE_ void
 out_be16(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t val)
 {
-	*addr = htons(val);
+	out_be16_relaxed(addr, val);
 	iobarrier_w();
 }
 
 static _INLINE_ void
 out_8(volatile unsigned char *addr, unsigned char val)
 {
-	*addr=val;
+	out_8_relaxed(addr, val);
+	iobarrier_w();
+}
+
+/* 64-bit accessors
+ *
+ * On 64-bit CPUs (__LP64__) a 64-bit register is accessed with
+ * a single bus transaction. Elsewhere the two 32-bit halves are
+ * accessed one after the other, always the half at the lower
+ * address first (i.e., the low word of a little-endian but the
+ * high word of a big-endian register), with a barrier between
+ * them. Such a read may tear if the register changes in between;
+ * in_le64_stable()/in_be64_stable() read a free-running counter
+ * consistently by re-reading the high word until it is unchanged
+ * (they are just in_le64()/in_be64() on 64-bit CPUs).
+ */
+#if defined(__LP64__) || defined(_LP64) || defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__)
+#define __IOOPS_HAS_64BIT_ACCESS
+#endif
+
+#ifdef __IOOPS_HAS_64BIT_ACCESS
+static _INLINE_ __TillsIoOps64_t
+in_le64_relaxed(volatile __TillsIoOps64_t *pval)
+{
+	return ENDIAN_TEST_IS_LITTLE ? *pval : __iobswap64(*pval);
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_be64_relaxed(volatile __TillsIoOps64_t *pval)
+{
+	return ENDIAN_TEST_IS_LITTLE ? __iobswap64(*pval) : *pval;
+}
+
+static _INLINE_ void
+out_le64_relaxed(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	*addr = ENDIAN_TEST_IS_LITTLE ? val : __iobswap64(val);
+}
+
+static _INLINE_ void
+out_be64_relaxed(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	*addr = ENDIAN_TEST_IS_LITTLE ? __iobswap64(val) : val;
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_le64(volatile __TillsIoOps64_t *pval)
+{
+__TillsIoOps64_t rval = in_le64_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_be64(volatile __TillsIoOps64_t *pval)
+{
+__TillsIoOps64_t rval = in_be64_relaxed(pval);
+	iobarrier_r();
+	return rval;
+}
+
+static _INLINE_ void
+out_le64(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	out_le64_relaxed(addr, val);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_be64(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	out_be64_relaxed(addr, val);
+	iobarrier_w();
+}
+
+#define in_le64_stable(pval)	in_le64(pval)
+#define in_be64_stable(pval)	in_be64(pval)
+
+#else /* two 32-bit transactions */
+
+/* the relaxed variants don't order the halves either */
+static _INLINE_ __TillsIoOps64_t
+in_le64_relaxed(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi;
+	lo = in_le32_relaxed(p);
+	hi = in_le32_relaxed(p + 1);
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_be64_relaxed(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi;
+	hi = in_be32_relaxed(p);
+	lo = in_be32_relaxed(p + 1);
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+
+static _INLINE_ void
+out_le64_relaxed(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)addr;
+	out_le32_relaxed(p,     (__TillsIoOps32_t)val);
+	out_le32_relaxed(p + 1, (__TillsIoOps32_t)(val >> 32));
+}
+
+static _INLINE_ void
+out_be64_relaxed(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)addr;
+	out_be32_relaxed(p,     (__TillsIoOps32_t)(val >> 32));
+	out_be32_relaxed(p + 1, (__TillsIoOps32_t)val);
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_le64(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi;
+	lo = in_le32(p);
+	hi = in_le32(p + 1);
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_be64(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi;
+	hi = in_be32(p);
+	lo = in_be32(p + 1);
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+
+static _INLINE_ void
+out_le64(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)addr;
+	out_le32(p,     (__TillsIoOps32_t)val);
+	out_le32(p + 1, (__TillsIoOps32_t)(val >> 32));
+}
+
+static _INLINE_ void
+out_be64(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)addr;
+	out_be32(p,     (__TillsIoOps32_t)(val >> 32));
+	out_be32(p + 1, (__TillsIoOps32_t)val);
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_le64_stable(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi, hi1;
+	hi = in_le32(p + 1);
+	do {
+		hi1 = hi;
+		lo  = in_le32(p);
+		hi  = in_le32(p + 1);
+	} while ( hi != hi1 );
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+
+static _INLINE_ __TillsIoOps64_t
+in_be64_stable(volatile __TillsIoOps64_t *pval)
+{
+volatile __TillsIoOps32_t *p = (volatile __TillsIoOps32_t*)pval;
+__TillsIoOps32_t lo, hi, hi1;
+	hi = in_be32(p);
+	do {
+		hi1 = hi;
+		lo  = in_be32(p + 1);
+		hi  = in_be32(p);
+	} while ( hi != hi1 );
+	return ((__TillsIoOps64_t)hi << 32) | lo;
+}
+#endif
+
+/* Block transfers
+ *
+ * in_<order><bits>_block() reads 'n' elements starting at device
+ * address 'addr' into the host buffer 'buf' converting them
+ * to CPU byte order, out_<order><bits>_block() writes them the
+ * other way round. The device is accessed element by element
+ * (i.e., with the element width) but there is only one barrier
+ * at the end of the transfer. Elements which need swapping are
+ * staged in small chunks and swapped with vector instructions
+ * where the compiler targets them (AVX2/SSSE3 'pshufb', NEON
+ * 'vrev').
+ */
+
+/* bytes staged at a time */
+#define __IOOPS_CHUNK 256
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSSE3__))
+#include <immintrin.h>
+#define __IOOPS_PSHUFB
+#elif defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define __IOOPS_VREV
+#endif
+
+/* Swap 'n' elements of 'size' bytes from 'src' to 'dst'
+ * (which may be the same buffer).
+ */
+static _INLINE_ void
+__ioswap_block(void *dst, const void *src, unsigned long n, int size)
+{
+unsigned char       *d  = (unsigned char*)dst;
+const unsigned char *s  = (const unsigned char*)src;
+unsigned long        nb = n * size, i = 0;
+#if defined(__IOOPS_PSHUFB)
+__m128i              m;
+
+	switch ( size ) {
+		case 2:  m = _mm_set_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1); break;
+		case 4:  m = _mm_set_epi8(12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3); break;
+		default: m = _mm_set_epi8(8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7); break;
+	}
+#if defined(__AVX2__)
+	{
+	__m256i m2 = _mm256_broadcastsi128_si256(m);
+	for ( ; i + 32 <= nb; i += 32 )
+		_mm256_storeu_si256((__m256i*)(d + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), m2));
+	}
+#endif
+	for ( ; i + 16 <= nb; i += 16 )
+		_mm_storeu_si128((__m128i*)(d + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(s + i)), m));
+#elif defined(__IOOPS_VREV)
+	for ( ; i + 16 <= nb; i += 16 ) {
+		switch ( size ) {
+			case 2:  vst1q_u8(d + i, vrev16q_u8(vld1q_u8(s + i))); break;
+			case 4:  vst1q_u8(d + i, vrev32q_u8(vld1q_u8(s + i))); break;
+			default: vst1q_u8(d + i, vrev64q_u8(vld1q_u8(s + i))); break;
+		}
+	}
+#endif
+	/* what's left (or everything) element by element */
+	for ( ; i < nb; i += size ) {
+		switch ( size ) {
+			case 2:
+				*(__TillsIoOps16_t*)(d + i) = __iobswap16(*(const __TillsIoOps16_t*)(s + i));
+			break;
+			case 4:
+				*(__TillsIoOps32_t*)(d + i) = __iobswap32(*(const __TillsIoOps32_t*)(s + i));
+			break;
+			default:
+				*(__TillsIoOps64_t*)(d + i) = __iobswap64(*(const __TillsIoOps64_t*)(s + i));
+			break;
+		}
+	}
+}
+
+/* plain copies of every width */
+#define __IOOPS_BLOCK_COPY(bits)                                                        \
+static _INLINE_ void                                                                    \
+__iocopy_in##bits(volatile __TillsIoOps##bits##_t *addr, __TillsIoOps##bits##_t *buf, unsigned long n) \
+{                                                                                       \
+unsigned long i;                                                                        \
+	for ( i = 0; i < n; i++ )                                                           \
+		buf[i] = addr[i];                                                               \
+}                                                                                       \
+                                                                                        \
+static _INLINE_ void                                                                    \
+__iocopy_out##bits(volatile __TillsIoOps##bits##_t *addr, const __TillsIoOps##bits##_t *buf, unsigned long n) \
+{                                                                                       \
+unsigned long i;                                                                        \
+	for ( i = 0; i < n; i++ )                                                           \
+		addr[i] = buf[i];                                                               \
+}
+
+__IOOPS_BLOCK_COPY(16)
+__IOOPS_BLOCK_COPY(32)
+__IOOPS_BLOCK_COPY(64)
+
+/* copies with byte swapping; staged through the host buffer
+ * (or a chunk on the stack) and swapped there.
+ */
+#define __IOOPS_BLOCK_SWAP(bits)                                                        \
+static _INLINE_ void                                                                    \
+__iocopy_in##bits##_swap(volatile __TillsIoOps##bits##_t *addr, __TillsIoOps##bits##_t *buf, unsigned long n) \
+{                                                                                       \
+unsigned long k;                                                                        \
+	for ( ; n > 0; n -= k, addr += k, buf += k ) {                                      \
+		k = n < __IOOPS_CHUNK*8/bits ? n : __IOOPS_CHUNK*8/bits;                        \
+		__iocopy_in##bits(addr, buf, k);                                                \
+		__ioswap_block(buf, buf, k, bits/8);                                            \
+	}                                                                                   \
+}                                                                                       \
+                                                                                        \
+static _INLINE_ void                                                                    \
+__iocopy_out##bits##_swap(volatile __TillsIoOps##bits##_t *addr, const __TillsIoOps##bits##_t *buf, unsigned long n) \
+{                                                                                       \
+__TillsIoOps##bits##_t tmp[__IOOPS_CHUNK*8/bits];                                       \
+unsigned long k;                                                                        \
+	for ( ; n > 0; n -= k, addr += k, buf += k ) {                                      \
+		k = n < __IOOPS_CHUNK*8/bits ? n : __IOOPS_CHUNK*8/bits;                        \
+		__ioswap_block(tmp, buf, k, bits/8);                                            \
+		__iocopy_out##bits(addr, tmp, k);                                               \
+	}                                                                                   \
+}
+
+#ifdef ASSEMBLEPPC
+/* the byte-reversing loads/stores are as fast as plain ones */
+static _INLINE_ void
+__iocopy_in16_swap(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		__asm__ __volatile__("lhbrx %0, 0, %1":"=r"(buf[i]):"r"(addr + i));
+}
+
+static _INLINE_ void
+__iocopy_in32_swap(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		__asm__ __volatile__("lwbrx %0, 0, %1":"=r"(buf[i]):"r"(addr + i));
+}
+
+static _INLINE_ void
+__iocopy_out16_swap(volatile __TillsIoOps16_t *addr, const __TillsIoOps16_t *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		__asm__ __volatile__("sthbrx %1, 0, %2":"=m"(addr[i]):"r"(buf[i]),"r"(addr + i));
+}
+
+static _INLINE_ void
+__iocopy_out32_swap(volatile __TillsIoOps32_t *addr, const __TillsIoOps32_t *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		__asm__ __volatile__("stwbrx %1, 0, %2":"=m"(addr[i]):"r"(buf[i]),"r"(addr + i));
+}
+#else
+__IOOPS_BLOCK_SWAP(16)
+__IOOPS_BLOCK_SWAP(32)
+#endif
+__IOOPS_BLOCK_SWAP(64)
+
+static _INLINE_ void
+in_8_block(volatile unsigned char *addr, unsigned char *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		buf[i] = addr[i];
+	iobarrier_r();
+}
+
+static _INLINE_ void
+out_8_block(volatile unsigned char *addr, const unsigned char *buf, unsigned long n)
+{
+unsigned long i;
+	for ( i = 0; i < n; i++ )
+		addr[i] = buf[i];
+	iobarrier_w();
+}
+
+static _INLINE_ void
+in_le16_block(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in16(addr, buf, n);
+	else
+		__iocopy_in16_swap(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+in_be16_block(volatile __TillsIoOps16_t *addr, __TillsIoOps16_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in16_swap(addr, buf, n);
+	else
+		__iocopy_in16(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+in_le32_block(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in32(addr, buf, n);
+	else
+		__iocopy_in32_swap(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+in_be32_block(volatile __TillsIoOps32_t *addr, __TillsIoOps32_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in32_swap(addr, buf, n);
+	else
+		__iocopy_in32(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+in_le64_block(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in64(addr, buf, n);
+	else
+		__iocopy_in64_swap(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+in_be64_block(volatile __TillsIoOps64_t *addr, __TillsIoOps64_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_in64_swap(addr, buf, n);
+	else
+		__iocopy_in64(addr, buf, n);
+	iobarrier_r();
+}
+
+static _INLINE_ void
+out_le16_block(volatile __TillsIoOps16_t *addr, const __TillsIoOps16_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out16(addr, buf, n);
+	else
+		__iocopy_out16_swap(addr, buf, n);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_be16_block(volatile __TillsIoOps16_t *addr, const __TillsIoOps16_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out16_swap(addr, buf, n);
+	else
+		__iocopy_out16(addr, buf, n);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_le32_block(volatile __TillsIoOps32_t *addr, const __TillsIoOps32_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out32(addr, buf, n);
+	else
+		__iocopy_out32_swap(addr, buf, n);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_be32_block(volatile __TillsIoOps32_t *addr, const __TillsIoOps32_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out32_swap(addr, buf, n);
+	else
+		__iocopy_out32(addr, buf, n);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_le64_block(volatile __TillsIoOps64_t *addr, const __TillsIoOps64_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out64(addr, buf, n);
+	else
+		__iocopy_out64_swap(addr, buf, n);
+	iobarrier_w();
+}
+
+static _INLINE_ void
+out_be64_block(volatile __TillsIoOps64_t *addr, const __TillsIoOps64_t *buf, unsigned long n)
+{
+	if (ENDIAN_TEST_IS_LITTLE)
+		__iocopy_out64_swap(addr, buf, n);
+	else
+		__iocopy_out64(addr, buf, n);
 	iobarrier_w();
 }
 
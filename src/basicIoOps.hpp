@@ -0,0 +1,174 @@
+#ifndef TILLS_INPUT_OUTPUT_OPERA_HPP
+#define TILLS_INPUT_OUTPUT_OPERA_HPP
+
+/* Typed register access for C++ (header only)
+ *
+ * A register is described by its width, the byte order of the
+ * device and whether it may be read and/or written:
+ *
+ *   typedef basicIoOps::Reg<uint32_t, basicIoOps::BigEndian, basicIoOps::RO> StatusReg;
+ *
+ *   StatusReg csr( base + 0x10 );
+ *   uint32_t  v = csr.read();
+ *   csr.write(0);           // does not compile; 'csr' is read-only
+ *
+ * The byte order of the host is known at compile time, i.e.,
+ * an access is a single load or store which is followed by a
+ * byte swap only if the orders differ. Accesses are ordered
+ * by the same barriers as the C routines (basicIoOps.h) which
+ * remain available. Needs C++11.
+ */
+
+#include <stdint.h>
+
+#include "basicIoOps.h"
+
+#ifndef iobarrier_r
+/* RTEMS' <libcpu/io.h> provides the accessors but no barriers */
+#if defined(_ARCH_PPC) || defined(__PPC__) || defined(__PPC)
+#define iobarrier_r()	do { __asm__ __volatile__ ("eieio"); } while(0)
+#define iobarrier_rw()	do { __asm__ __volatile__ ("eieio"); } while(0)
+#define iobarrier_w()	do { __asm__ __volatile__ ("eieio"); } while(0)
+#else
+#define iobarrier_r()	do {} while(0)
+#define iobarrier_rw()	do {} while(0)
+#define iobarrier_w()	do {} while(0)
+#endif
+#endif
+
+#if __cplusplus >= 202002L
+#include <bit>
+#endif
+
+namespace basicIoOps {
+
+enum Endian {
+	LittleEndian,
+	BigEndian,
+#if defined(__cpp_lib_endian)
+	NativeEndian = ( std::endian::native == std::endian::little ? LittleEndian : BigEndian )
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+	NativeEndian = ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? LittleEndian : BigEndian )
+#elif defined(__BIG_ENDIAN__) || defined(_BIG_ENDIAN) || defined(__ARMEB__) || defined(__MIPSEB__)
+	NativeEndian = BigEndian
+#elif defined(__LITTLE_ENDIAN__) || defined(_LITTLE_ENDIAN) || defined(__i386__) || defined(__x86_64__)
+	NativeEndian = LittleEndian
+#else
+#error "Unable to determine the byte order of this CPU at compile time"
+#endif
+};
+
+enum Access {
+	RO = 1,
+	WO = 2,
+	RW = RO | WO
+};
+
+namespace detail {
+
+/* Byte swap of a 1, 2, 4 or 8 byte integer; the compiler
+ * recognizes these and emits its swap instruction.
+ */
+template <unsigned size> struct Swap;
+
+template <> struct Swap<1> {
+	template <typename T> static T swap(T v) { return v; }
+};
+
+template <> struct Swap<2> {
+	template <typename T> static T swap(T v)
+	{
+	uint16_t u = (uint16_t)v;
+		return (T)(uint16_t)((u << 8) | (u >> 8));
+	}
+};
+
+template <> struct Swap<4> {
+	template <typename T> static T swap(T v)
+	{
+	uint32_t u = (uint32_t)v;
+		return (T)(((u & 0xff000000) >> 24) |
+		           ((u & 0x00ff0000) >>  8) |
+		           ((u & 0x0000ff00) <<  8) |
+		           ((u & 0x000000ff) << 24));
+	}
+};
+
+template <> struct Swap<8> {
+	template <typename T> static T swap(T v)
+	{
+	uint64_t u = (uint64_t)v;
+		return (T)( ((uint64_t)Swap<4>::swap((uint32_t)u) << 32) | Swap<4>::swap((uint32_t)(u >> 32)) );
+	}
+};
+
+/* convert between host and device order; the swap is
+ * only instantiated if the orders differ.
+ */
+template <typename T, bool differ> struct Conv {
+	static T conv(T v) { return v; }
+};
+
+template <typename T> struct Conv<T, true> {
+	static T conv(T v) { return Swap<sizeof(T)>::swap(v); }
+};
+
+} /* namespace detail */
+
+template <typename T, Endian E, Access A = RW>
+class Reg {
+	typedef detail::Conv<T, E != NativeEndian> Conv;
+
+	volatile T *addr_;
+
+public:
+	typedef T Type;
+
+	explicit Reg(volatile void *addr)
+	: addr_( (volatile T*)addr )
+	{
+	}
+
+	/* register at 'off' bytes into a block */
+	Reg(volatile void *base, unsigned long off)
+	: addr_( (volatile T*)((volatile char*)base + off) )
+	{
+	}
+
+	T read() const
+	{
+		static_assert( A & RO, "register is write-only" );
+		T v = *addr_;
+		iobarrier_r();
+		return Conv::conv(v);
+	}
+
+	void write(T v) const
+	{
+		static_assert( A & WO, "register is read-only" );
+		*addr_ = Conv::conv(v);
+		iobarrier_w();
+	}
+
+	/* w/o barrier; see iobarrier_r()/iobarrier_w() */
+	T readRelaxed() const
+	{
+		static_assert( A & RO, "register is write-only" );
+		return Conv::conv(*addr_);
+	}
+
+	void writeRelaxed(T v) const
+	{
+		static_assert( A & WO, "register is read-only" );
+		*addr_ = Conv::conv(v);
+	}
+
+	volatile T *address() const
+	{
+		return addr_;
+	}
+};
+
+} /* namespace basicIoOps */
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Device support publishing savres statistics (see savresGetStats)
+ *
+ *   record(ai, "$(P):SAVRES_ERRORS") {
+ *     field(DTYP, "savres Stats")
+ *     field(INP,  "@errors [recordName]")
+ *     field(SCAN, "10 second")
+ *   }
+ *
+ * The totals are read if no record name is given. Available
+ * figures are listed in 'stats' below; times are in ms except
+ * for 'age' which is the number of seconds since the file
+ * was last known to be up to date, i.e., since the last
+ * successful save or save of unchanged data (INVALID if there
+ * never was one) and may be used to alarm on stale saves.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <alarm.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <link.h>
+#include <aiRecord.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <epicsExport.h>
+
+#include "savresUtil.h"
+
+typedef enum {
+	ST_SUBMITS, ST_COALESCED, ST_OVERFLOWS, ST_DROPPED, ST_SAVES, ST_SKIPPED,
+	ST_ERRORS, ST_BYTES, ST_WAIT_AVG, ST_WAIT_MAX, ST_LAT_AVG, ST_LAT_MAX,
+	ST_AGE, ST_ERRNO
+} StatId;
+
+static const struct {
+	const char *nam;
+	StatId      id;
+} stats[] = {
+	{ "submits",   ST_SUBMITS   },
+	{ "coalesced", ST_COALESCED },
+	{ "overflows", ST_OVERFLOWS },
+	{ "dropped",   ST_DROPPED   },
+	{ "saves",     ST_SAVES     },
+	{ "skipped",   ST_SKIPPED   },
+	{ "errors",    ST_ERRORS    },
+	{ "bytes",     ST_BYTES     },
+	{ "waitAvg",   ST_WAIT_AVG  },
+	{ "waitMax",   ST_WAIT_MAX  },
+	{ "latAvg",    ST_LAT_AVG   },
+	{ "latMax",    ST_LAT_MAX   },
+	{ "age",       ST_AGE       },
+	{ "errno",     ST_ERRNO     },
+};
+
+typedef struct DevStatsRec_ {
+	StatId id;
+	char   rec[PVNAME_STRINGSZ];
+} DevStatsRec, *DevStats;
+
+static long
+init_record(aiRecord *prec)
+{
+DevStats p;
+char     nam[20];
+int      i, n;
+
+	if ( INST_IO != prec->inp.type ) {
+		recGblRecordError(S_dev_badInpType, prec, "devAiSavresStats (init_record) INP must be INST_IO");
+		return S_dev_badInpType;
+	}
+
+	if ( ! (p = calloc(1, sizeof(*p))) ) {
+		recGblRecordError(S_dev_noMemory, prec, "devAiSavresStats (init_record) no memory");
+		return S_dev_noMemory;
+	}
+
+	n = sscanf(prec->inp.value.instio.string, "%19s %60s", nam, p->rec);
+	for ( i = 0; n > 0 && i < sizeof(stats)/sizeof(stats[0]); i++ ) {
+		if ( ! strcmp(nam, stats[i].nam) )
+			break;
+	}
+	if ( n < 1 || i == sizeof(stats)/sizeof(stats[0]) ) {
+		recGblRecordError(S_dev_badRequest, prec, "devAiSavresStats (init_record) unknown statistic");
+		free(p);
+		return S_dev_badRequest;
+	}
+	p->id      = stats[i].id;
+	prec->dpvt = p;
+	return 0;
+}
+
+static long
+read_ai(aiRecord *prec)
+{
+DevStats       p = prec->dpvt;
+SavResStatsRec s;
+epicsTimeStamp now;
+unsigned long  n;
+double         v = 0.;
+
+	if ( !p )
+		return 2;
+
+	if ( savresGetStats(p->rec, &s) ) {
+		/* record not (yet) saved asynchronously */
+		recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+		return 2;
+	}
+
+	n = s.submits - s.coalesced;
+
+	switch ( p->id ) {
+		case ST_SUBMITS:   v = s.submits;   break;
+		case ST_COALESCED: v = s.coalesced; break;
+		case ST_OVERFLOWS: v = s.overflows; break;
+		case ST_DROPPED:   v = s.dropped;   break;
+		case ST_SAVES:     v = s.saves;     break;
+		case ST_SKIPPED:   v = s.skipped;   break;
+		case ST_ERRORS:    v = s.errors;    break;
+		case ST_BYTES:     v = s.bytes;     break;
+		case ST_WAIT_AVG:  v = n       ? s.waitSum / n       : 0.; break;
+		case ST_WAIT_MAX:  v = s.waitMax;   break;
+		case ST_LAT_AVG:   v = s.saves ? s.latSum  / s.saves : 0.; break;
+		case ST_LAT_MAX:   v = s.latMax;    break;
+		case ST_ERRNO:     v = s.lastErrno; break;
+		case ST_AGE:
+			if ( ! s.lastSuccess.secPastEpoch ) {
+				recGblSetSevr(prec, UDF_ALARM, INVALID_ALARM);
+				return 2;
+			}
+			epicsTimeGetCurrent(&now);
+			v = epicsTimeDiffInSeconds(&now, &s.lastSuccess);
+		break;
+	}
+
+	prec->val = v;
+	prec->udf = FALSE;
+	/* don't convert */
+	return 2;
+}
+
+struct {
+	long      number;
+	DEVSUPFUN report;
+	DEVSUPFUN init;
+	DEVSUPFUN init_record;
+	DEVSUPFUN get_ioint_info;
+	DEVSUPFUN read_ai;
+	DEVSUPFUN special_linconv;
+} devAiSavresStats = {
+	6,
+	NULL,
+	NULL,
+	(DEVSUPFUN)init_record,
+	NULL,
+	(DEVSUPFUN)read_ai,
+	NULL
+};
+epicsExportAddress(dset, devAiSavresStats);
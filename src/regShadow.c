@@ -0,0 +1,233 @@
+#include <stdlib.h>
+
+#include <epicsMutex.h>
+#include <errlog.h>
+
+#include "basicIoOps.h"
+#include "regShadow.h"
+
+/* Shadowed device registers; see regShadow.h */
+
+typedef struct RegShadowValRec_ {
+	epicsUInt32            val;
+	int                    valid;
+} RegShadowValRec;
+
+typedef struct RegShadowBlkRec_ {
+	volatile char         *base;
+	const RegShadowRegRec *regs;
+	int                    nregs;
+	epicsMutexId           mtx;     /* NULL if not locked */
+	unsigned long          busReads;
+	unsigned long          shadowReads;
+	RegShadowValRec        shadow[1];
+} RegShadowBlkRec;
+
+#define LOCK(b)   do { if ( (b)->mtx ) epicsMutexMustLock( (b)->mtx ); } while (0)
+#define UNLOCK(b) do { if ( (b)->mtx ) epicsMutexUnlock( (b)->mtx ); } while (0)
+
+/* all but volatile registers are served by the shadow once it is valid */
+#define cached(r) ( ! ((r)->flags & REGSHADOW_VOLATILE) )
+
+static epicsUInt32 busRd(RegShadowBlk b, const RegShadowRegRec *r)
+{
+volatile char *a = b->base + r->off;
+
+	b->busReads++;
+	switch ( r->width ) {
+		case 8:
+			return in_8((volatile unsigned char*)a);
+		case 16:
+			return (r->flags & REGSHADOW_LE) ? in_le16((volatile epicsUInt16*)a) : in_be16((volatile epicsUInt16*)a);
+		default:
+			return (r->flags & REGSHADOW_LE) ? in_le32((volatile epicsUInt32*)a) : in_be32((volatile epicsUInt32*)a);
+	}
+}
+
+static void busWr(RegShadowBlk b, const RegShadowRegRec *r, epicsUInt32 v)
+{
+volatile char *a = b->base + r->off;
+
+	switch ( r->width ) {
+		case 8:
+			out_8((volatile unsigned char*)a, v);
+		break;
+		case 16:
+			if ( r->flags & REGSHADOW_LE )
+				out_le16((volatile epicsUInt16*)a, v);
+			else
+				out_be16((volatile epicsUInt16*)a, v);
+		break;
+		default:
+			if ( r->flags & REGSHADOW_LE )
+				out_le32((volatile epicsUInt32*)a, v);
+			else
+				out_be32((volatile epicsUInt32*)a, v);
+		break;
+	}
+}
+
+/* current contents of a register; caller holds the lock */
+static epicsUInt32 curVal(RegShadowBlk b, int reg)
+{
+const RegShadowRegRec *r = &b->regs[reg];
+RegShadowValRec       *s = &b->shadow[reg];
+
+	if ( s->valid ) {
+		b->shadowReads++;
+		return s->val;
+	}
+	s->val   = busRd(b, r);
+	s->valid = cached(r);
+	return s->val;
+}
+
+/* store a value; caller holds the lock */
+static void setVal(RegShadowBlk b, int reg, epicsUInt32 v)
+{
+	busWr(b, &b->regs[reg], v);
+	b->shadow[reg].val   = v;
+	b->shadow[reg].valid = cached(&b->regs[reg]);
+}
+
+static void invalidate(RegShadowBlk b, int reg)
+{
+const RegShadowRegRec *r = &b->regs[reg];
+
+	if ( r->flags & REGSHADOW_WO ) {
+		b->shadow[reg].val   = r->init;
+		b->shadow[reg].valid = 1;
+	} else {
+		b->shadow[reg].valid = 0;
+	}
+}
+
+static int badReg(RegShadowBlk b, int reg, const char *caller)
+{
+	if ( reg < 0 || reg >= b->nregs ) {
+		errlogPrintf("%s: invalid register index %i\n", caller, reg);
+		return 1;
+	}
+	return 0;
+}
+
+RegShadowBlk
+regShadowCreate(volatile void *base, const RegShadowRegRec *regs, int nregs, int flags)
+{
+RegShadowBlk b;
+int          i;
+
+	if ( nregs < 1 ) {
+		errlogPrintf("regShadowCreate: need at least one register\n");
+		return 0;
+	}
+	for ( i = 0; i < nregs; i++ ) {
+		if ( 8 != regs[i].width && 16 != regs[i].width && 32 != regs[i].width ) {
+			errlogPrintf("regShadowCreate: register %i has unsupported width %i\n", i, regs[i].width);
+			return 0;
+		}
+		if ( (regs[i].flags & REGSHADOW_WO) && (regs[i].flags & REGSHADOW_VOLATILE) ) {
+			errlogPrintf("regShadowCreate: register %i can't be write-only and volatile\n", i);
+			return 0;
+		}
+	}
+	if ( ! (b = calloc(1, sizeof(*b) + (nregs - 1) * sizeof(b->shadow[0]))) ) {
+		errlogPrintf("regShadowCreate: no memory\n");
+		return 0;
+	}
+	b->base  = base;
+	b->regs  = regs;
+	b->nregs = nregs;
+	if ( (flags & REGSHADOW_LOCKED) )
+		b->mtx = epicsMutexMustCreate();
+	for ( i = 0; i < nregs; i++ )
+		invalidate(b, i);
+	return b;
+}
+
+void
+regShadowDestroy(RegShadowBlk b)
+{
+	if ( ! b )
+		return;
+	if ( b->mtx )
+		epicsMutexDestroy(b->mtx);
+	free(b);
+}
+
+epicsUInt32
+regShadowRead(RegShadowBlk b, int reg)
+{
+epicsUInt32 v;
+
+	if ( badReg(b, reg, "regShadowRead") )
+		return 0;
+	LOCK(b);
+	v = curVal(b, reg);
+	UNLOCK(b);
+	return v;
+}
+
+void
+regShadowWrite(RegShadowBlk b, int reg, epicsUInt32 val)
+{
+	if ( badReg(b, reg, "regShadowWrite") )
+		return;
+	LOCK(b);
+	setVal(b, reg, val);
+	UNLOCK(b);
+}
+
+epicsUInt32
+regShadowUpdate(RegShadowBlk b, int reg, epicsUInt32 mask, epicsUInt32 val)
+{
+epicsUInt32 v;
+
+	if ( badReg(b, reg, "regShadowUpdate") )
+		return 0;
+	LOCK(b);
+	v = (curVal(b, reg) & ~mask) | (val & mask);
+	setVal(b, reg, v);
+	UNLOCK(b);
+	return v;
+}
+
+epicsUInt32
+regShadowGetField(RegShadowBlk b, const RegShadowFieldRec *f)
+{
+	return (regShadowRead(b, f->reg) >> f->shift) & f->mask;
+}
+
+epicsUInt32
+regShadowUpdateField(RegShadowBlk b, const RegShadowFieldRec *f, epicsUInt32 val)
+{
+	return regShadowUpdate(b, f->reg, f->mask << f->shift, (val & f->mask) << f->shift);
+}
+
+void
+regShadowInvalidate(RegShadowBlk b, int reg)
+{
+int i;
+
+	if ( reg >= 0 && badReg(b, reg, "regShadowInvalidate") )
+		return;
+	LOCK(b);
+	if ( reg < 0 ) {
+		for ( i = 0; i < b->nregs; i++ )
+			invalidate(b, i);
+	} else {
+		invalidate(b, reg);
+	}
+	UNLOCK(b);
+}
+
+void
+regShadowGetCounts(RegShadowBlk b, unsigned long *busReads, unsigned long *shadowReads)
+{
+	LOCK(b);
+	if ( busReads )
+		*busReads = b->busReads;
+	if ( shadowReads )
+		*shadowReads = b->shadowReads;
+	UNLOCK(b);
+}
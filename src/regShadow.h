@@ -0,0 +1,134 @@
+#ifndef REG_SHADOW_H
+#define REG_SHADOW_H
+
+/* Shadowed device registers
+ *
+ * Reading a register over a bridge (VME, PCIe) costs a non-posted
+ * bus transaction, i.e., microseconds. A read-modify-write that
+ * only flips a bit therefore mostly waits for the read. This
+ * facility keeps a copy (shadow) of registers whose contents
+ * only change when they are written, so that such updates are
+ * just a (posted) write.
+ *
+ * A block of registers is described by a table:
+ *
+ *   static const RegShadowRegRec myRegs[] = {
+ *     { 0x00, 32, REGSHADOW_BE,                      0 }, // control
+ *     { 0x04, 32, REGSHADOW_BE | REGSHADOW_VOLATILE, 0 }, // status
+ *     { 0x08, 16, REGSHADOW_LE | REGSHADOW_WO,   0x100 }, // DAC
+ *   };
+ *   static const RegShadowFieldRec gain = REGSHADOW_FIELD(0, 4, 3);
+ *
+ *   b = regShadowCreate(base, myRegs, 3, REGSHADOW_LOCKED);
+ *   regShadowSetBits(b, 0, 0x1);
+ *   regShadowUpdateField(b, &gain, 5);
+ *
+ * Registers are accessed with the routines of basicIoOps.h:
+ *  - plain registers are read once (on first use or after
+ *    regShadowInvalidate); the shadow serves all further
+ *    reads and read-modify-writes. Writes go through to the
+ *    device and update the shadow.
+ *  - write-only registers (REGSHADOW_WO) are never read; the
+ *    shadow starts out with their reset value ('init').
+ *  - volatile registers (REGSHADOW_VOLATILE; e.g., status) are
+ *    always read from the device.
+ *
+ * Blocks created with REGSHADOW_LOCKED may be used by several
+ * threads; a read-modify-write is then atomic with respect to
+ * the other users of the block (but not to other software
+ * accessing the registers directly).
+ */
+
+#include <epicsTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* register flags */
+#define REGSHADOW_BE        0   /* big-endian (default) */
+#define REGSHADOW_LE        1   /* little-endian        */
+#define REGSHADOW_WO        2   /* write-only           */
+#define REGSHADOW_VOLATILE  4   /* changed by the device */
+
+typedef struct RegShadowRegRec_ {
+	unsigned long  off;    /* byte offset into the block  */
+	int            width;  /* 8, 16 or 32 bits            */
+	int            flags;
+	epicsUInt32    init;   /* reset value if write-only   */
+} RegShadowRegRec;
+
+/* A bit field of a register */
+typedef struct RegShadowFieldRec_ {
+	int            reg;    /* index into the register table */
+	int            shift;
+	epicsUInt32    mask;   /* right-aligned                 */
+} RegShadowFieldRec;
+
+#define REGSHADOW_FIELD(reg, shift, bits) \
+	{ (reg), (shift), (epicsUInt32)( (bits) >= 32 ? 0xffffffff : (1UL << (bits)) - 1 ) }
+
+/* block flags */
+#define REGSHADOW_LOCKED    1   /* serialize concurrent users */
+
+typedef struct RegShadowBlkRec_ *RegShadowBlk;
+
+/* Create a shadow for the 'nregs' registers described by
+ * 'regs' (the table is referenced, not copied) of a block
+ * at 'base'. The device is not accessed.
+ *
+ * RETURNS: block or NULL (invalid table or no memory).
+ */
+RegShadowBlk
+regShadowCreate(volatile void *base, const RegShadowRegRec *regs, int nregs, int flags);
+
+void
+regShadowDestroy(RegShadowBlk b);
+
+/* RETURNS: value of register 'reg' (from the shadow if it is valid) */
+epicsUInt32
+regShadowRead(RegShadowBlk b, int reg);
+
+/* Write 'val' to register 'reg' (and its shadow) */
+void
+regShadowWrite(RegShadowBlk b, int reg, epicsUInt32 val);
+
+/* Replace the bits of 'mask' in register 'reg' by those of 'val';
+ * the device is only read if the shadow is not valid.
+ *
+ * RETURNS: the new value.
+ */
+epicsUInt32
+regShadowUpdate(RegShadowBlk b, int reg, epicsUInt32 mask, epicsUInt32 val);
+
+#define regShadowSetBits(b, reg, bits)    regShadowUpdate((b), (reg), (bits), (bits))
+#define regShadowClearBits(b, reg, bits)  regShadowUpdate((b), (reg), (bits), 0)
+
+/* RETURNS: value of a field */
+epicsUInt32
+regShadowGetField(RegShadowBlk b, const RegShadowFieldRec *f);
+
+/* Set a field to 'val' (truncated to its width).
+ *
+ * RETURNS: the new value of the register.
+ */
+epicsUInt32
+regShadowUpdateField(RegShadowBlk b, const RegShadowFieldRec *f, epicsUInt32 val);
+
+/* Forget the contents of register 'reg' (of all registers if
+ * 'reg' is negative), e.g., after resetting the device. Readable
+ * registers are read again on next use; write-only registers
+ * revert to their reset value.
+ */
+void
+regShadowInvalidate(RegShadowBlk b, int reg);
+
+/* Number of device reads done and of reads served by the shadow */
+void
+regShadowGetCounts(RegShadowBlk b, unsigned long *busReads, unsigned long *shadowReads);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
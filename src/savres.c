@@ -1,3 +1,6 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* syscall() */
+#endif
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,8 +8,20 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "savresUtil.h"
+#include "savresPvt.h"
+
+#ifdef HAS_MMAP
+#include <sys/mman.h>
+#endif
 
 /* $Id: savres.c,v 1.2 2012/11/20 17:14:32 strauman Exp $ */
 
@@ -14,277 +29,3357 @@
 
 /* Author: Till Straumann <strauman@slac.stanford.edu>, 2006 */
 
-/* undef only for testing; no true multi-threading is possible
- * w/o message queue (only a single aao supported).
- */
-#define HAS_MSGQ
-
 #ifndef NO_EPICS
 #include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsInterrupt.h>
+#include <epicsTime.h>
+#include <epicsVersion.h>
 #include <aaoRecord.h>
 #include <dbCommon.h>
+#include <dbDefs.h>
+#include <dbFldTypes.h>
 #include <dbLock.h>
 #include <recSup.h>
 #include <recGbl.h>
+#include <alarm.h>
+#include <dbEvent.h>
+#include <caeventmask.h>
 #include <errlog.h>
-#include <assert.h>
-#ifdef HAS_MSGQ
-#include <epicsMessageQueue.h>
-#else
-#warning "no epicsMessageQueue; use for TESTING ONLY"
-#include <epicsEvent.h>
-static aaoRecord *theRec = 0;
-#define epicsMessageQueueId epicsEventId
-#define epicsMessageQueueCreate(nelms, size) epicsEventCreate(0)
-#define epicsMessageQueueSend(q,x,s)         do { theRec = *(x); epicsEventSignal(q); } while (0)
-#define epicsMessageQueueReceive(q, pm, s)   do { epicsEventWait(q); *(pm) = theRec;  } while (0) 
-#endif
+#include <iocsh.h>
+#include <initHooks.h>
+#include <epicsExport.h>
 #endif
 
-epicsMessageQueueId aaoSavResQId = 0;
+/* Suffix of the temporary file a new version is written
+ * to before it atomically replaces the old one.
+ */
+#define TMP_SUFFIX ".tmp"
+
+/* copies bigger than this use non-temporal stores */
+#define NT_COPY_MIN (4*1024*1024)
+
+int savresDurability = SAVRES_DURABLE_BATCH;
+int savresCodec      = SAVRES_CODEC_NONE;
+int savresUncachedMin = 0;
+int savresShardLevels = 0;
+
+/* Uncached I/O: files are transferred in chunks of this size
+ * (a multiple of the alignment O_DIRECT requires).
+ */
+#define UNCACHED_CHUNK (1024*1024)
+#define UNCACHED_ALIGN 4096
+
+#define uncached(n) ( savresUncachedMin > 0 && (unsigned long)(n) >= (unsigned long)savresUncachedMin )
+
+unsigned
+savresNameHash(const char *nam)
+{
+unsigned h = 5381;
+	while ( *nam )
+		h = (h<<5) + h + (unsigned char)*nam++;
+	return h;
+}
+
+/* Adler-32; 5552 is the largest block which cannot
+ * overflow the 32-bit sums.
+ */
+epicsUInt32
+savresChecksum(const void *buf, unsigned long n)
+{
+	return savresChecksumCont(SAVRES_CSUM_INIT, buf, n);
+}
+
+epicsUInt32
+savresChecksumCont(epicsUInt32 sum, const void *buf, unsigned long n)
+{
+const unsigned char *p = buf;
+epicsUInt32         a  = sum & 0xffff, b = sum >> 16;
+unsigned long       l;
+
+	while ( n > 0 ) {
+		l  = n < 5552 ? n : 5552;
+		n -= l;
+		while ( l-- ) {
+			a += *p++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+/* RETURNS: number of hashed directory levels for 'fnam' */
+static int shardLevels(const char *fnam)
+{
+	if ( savresShardLevels <= 0 || '/' == fnam[0] )
+		return 0;
+	return savresShardLevels > SAVRES_SHARD_MAX ? SAVRES_SHARD_MAX : savresShardLevels;
+}
 
-static char *mkfnam(char *path, char *fnam)
+/* build '[<path>/][xx/...]<fnam>[<sfx>]' with 'lvl' hashed levels */
+static char *mkfnamLvl(char *path, char *fnam, char *sfx, int lvl)
 {
-char *s = malloc( ( path ? strlen(path) : 0 ) + strlen(fnam) + 2);
+char     *s = malloc( ( path ? strlen(path) : 0 ) + strlen(fnam) + ( sfx ? strlen(sfx) : 0 ) + 3*lvl + 2);
+char     *p;
+unsigned h;
+int      i;
 
 	if ( s ) {
 		if ( path )
-			sprintf(s,"%s/%s", path, fnam);
+			sprintf(s,"%s/", path);
 		else
-			strcpy(s,fnam);
+			*s = 0;
+		p = s + strlen(s);
+		for ( i = 0, h = savresNameHash(fnam); i < lvl; i++, h >>= 8 )
+			p += sprintf(p, "%02x/", h & 0xff);
+		strcpy(p,fnam);
+		if ( sfx )
+			strcat(s,sfx);
 	}
 
 	return s;
 }
 
-int
-savresDumpData(char *path, char *fnam, char *buf, int n)
+static char *mkfnam(char *path, char *fnam, char *sfx)
 {
-int  rval = -1;
-char *s   = mkfnam(path,fnam);
-int  fd   = -1;
-int  put;
-char *rbuf;
+	return mkfnamLvl(path, fnam, sfx, shardLevels(fnam));
+}
 
-	if ( !s )
+/* Write all of 'cnt' segments to 'fd' at offset 'off' (at
+ * the current position if 'off' < 0).
+ * RETURNS: 0 on success, -1 on failure (errno set).
+ */
+static int
+writeAllAt(int fd, const struct iovec *iov, int cnt, off_t off)
+{
+#ifdef HAS_WRITEV
+struct iovec v[IOV_CHUNK];
+int          i, k;
+#else
+char         *p;
+unsigned long l;
+#endif
+ssize_t      put;
+
+#ifndef HAS_PREADV
+	if ( off >= 0 && lseek(fd, off, SEEK_SET) < 0 )
 		return -1;
+#endif
 
-	if ( (fd=open(s,O_WRONLY|O_CREAT|O_TRUNC,0777)) < 0 ) {
-		errlogPrintf("savresDumpData; unable to open file for writing: %s\n", strerror(errno));
-		goto cleanup;
-	}
-	n   *= sizeof(*buf);
-	rbuf = (char*)buf;
-	while ( (put = write(fd, rbuf, n)) > 0 ) {
-		n    -= put;
-		rbuf += put;
+#ifdef HAS_WRITEV
+	for ( ; cnt > 0; iov += k, cnt -= k ) {
+		for ( k = 0; k < cnt && k < IOV_CHUNK; k++ )
+			v[k] = iov[k];
+		for ( i = 0; ; ) {
+			while ( i < k && 0 == v[i].iov_len )
+				i++;
+			if ( i == k )
+				break;
+#ifdef HAS_PREADV
+			if ( off >= 0 )
+				put = pwritev(fd, v + i, k - i, off);
+			else
+#endif
+				put = writev(fd, v + i, k - i);
+			if ( put <= 0 ) {
+				if ( put < 0 && EINTR == errno )
+					continue;
+				if ( 0 == put )
+					errno = EIO;
+				return -1;
+			}
+			if ( off >= 0 )
+				off += put;
+			/* skip what was written */
+			for ( ; i < k && (size_t)put >= v[i].iov_len; i++ )
+				put -= v[i].iov_len;
+			if ( i < k ) {
+				v[i].iov_base  = (char*)v[i].iov_base + put;
+				v[i].iov_len  -= put;
+			}
+		}
 	}
-
-	if ( put < 0 ) {
-		errlogPrintf("savresDumpData; error writing data: %s\n", strerror(errno));
-		goto cleanup;
+#else
+	for ( ; cnt > 0; iov++, cnt-- ) {
+		for ( p = iov->iov_base, l = iov->iov_len; l > 0; p += put, l -= put ) {
+			if ( (put = write(fd, p, l)) <= 0 ) {
+				if ( put < 0 && EINTR == errno ) {
+					put = 0;
+					continue;
+				}
+				if ( 0 == put )
+					errno = EIO;
+				return -1;
+			}
+		}
 	}
+#endif
+	return 0;
+}
 
-	if ( n > 0 ) {
-		errlogPrintf("savresDumpData; didn't write all data\n");
-		goto cleanup;
-	}
+static int
+writeAll(int fd, const struct iovec *iov, int cnt)
+{
+	return writeAllAt(fd, iov, cnt, -1);
+}
 
-	rval = 0;
+/* Read 'fd' from offset 0 into 'cnt' segments (until they
+ * are full or EOF is reached); the file position must be
+ * 0 unless preadv is available.
+ * RETURNS: number of bytes read or -1 (errno set).
+ */
+static long
+readAll(int fd, const struct iovec *iov, int cnt)
+{
+#ifdef HAS_WRITEV
+struct iovec v[IOV_CHUNK];
+int          i, k;
+#else
+char         *p;
+unsigned long l;
+#endif
+ssize_t      got;
+long         rval = 0;
 
-cleanup:
-	if ( fd > -1 )
-		close(fd);
-	if ( rval ) {
-		if ( unlink(s) ) {
-			errlogPrintf("savresDumpData; WARNING: unable to remove bogus file: %s\n", strerror(errno));
+#ifdef HAS_WRITEV
+	for ( ; cnt > 0; iov += k, cnt -= k ) {
+		for ( k = 0; k < cnt && k < IOV_CHUNK; k++ )
+			v[k] = iov[k];
+		for ( i = 0; ; ) {
+			while ( i < k && 0 == v[i].iov_len )
+				i++;
+			if ( i == k )
+				break;
+#ifdef HAS_PREADV
+			got = preadv(fd, v + i, k - i, rval);
+#else
+			got = readv(fd, v + i, k - i);
+#endif
+			if ( got < 0 ) {
+				if ( EINTR == errno )
+					continue;
+				return -1;
+			}
+			if ( 0 == got )
+				return rval;
+			rval += got;
+			for ( ; i < k && (size_t)got >= v[i].iov_len; i++ )
+				got -= v[i].iov_len;
+			if ( i < k ) {
+				v[i].iov_base  = (char*)v[i].iov_base + got;
+				v[i].iov_len  -= got;
+			}
 		}
 	}
-	free(s);
+#else
+	for ( ; cnt > 0; iov++, cnt-- ) {
+		for ( p = iov->iov_base, l = iov->iov_len; l > 0; p += got, l -= got, rval += got ) {
+			if ( (got = read(fd, p, l)) < 0 ) {
+				if ( EINTR == errno ) {
+					got = 0;
+					continue;
+				}
+				return -1;
+			}
+			if ( 0 == got )
+				return rval;
+		}
+	}
+#endif
 	return rval;
 }
 
-int
-savresRstrData(char *path, char *fnam, char *buf, int n)
+/* Describe bytes ['off', 'off' + *plen) of 'cnt' segments
+ * by (at most IOV_CHUNK) entries of 'sub'; *plen is reduced
+ * if more would be needed.
+ * RETURNS: number of entries.
+ */
+static int
+iovSlice(const struct iovec *iov, int cnt, unsigned long off, unsigned long *plen, struct iovec *sub)
 {
-int  rval = -1;
-char *s   = mkfnam(path,fnam);
-int  fd   = -1;
-int  got,i;
-char *rbuf;
-mode_t file_permissions = (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
-
-	if ( !s )
-		return -1;
+unsigned long l, left = *plen;
+int           k = 0;
 
-	if ( (fd=open(s,O_RDONLY, file_permissions)) < 0 ) {
-		errlogPrintf("savresRstrData; unable to open file for reading: %s\n", strerror(errno));
-		goto cleanup;
+	for ( ; cnt > 0 && off >= iov->iov_len; iov++, cnt-- )
+		off -= iov->iov_len;
+	for ( ; cnt > 0 && left > 0 && k < IOV_CHUNK; iov++, cnt--, off = 0 ) {
+		if ( (l = iov->iov_len - off) > left )
+			l = left;
+		sub[k].iov_base = (char*)iov->iov_base + off;
+		sub[k].iov_len  = l;
+		left -= l;
+		k++;
 	}
+	*plen -= left;
+	return k;
+}
 
-	i    = n*sizeof(*buf);
-	rbuf = (char*)buf; 
-	/* read(x,y,0) returns 0 */
-	while ( (got = read(fd, rbuf, i)) > 0 ) {
-		rbuf += got;
-		i    -= got;
+/* Tell the kernel that a range of a file will be read soon
+ * or is not needed in the page cache any more.
+ */
+static void
+cacheHint(int fd, off_t off, unsigned long len, int dontneed)
+{
+#ifdef POSIX_FADV_DONTNEED
+	if ( dontneed ) {
+		posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+	} else {
+		posix_fadvise(fd, off, len, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(fd, off, len, POSIX_FADV_WILLNEED);
 	}
+#endif
+}
 
-	if ( got < 0 ) {
-		errlogPrintf("savresRstrData; error reading data: %s\n", strerror(errno));
-		goto cleanup;
+#ifdef O_DIRECT
+/* Write 'total' bytes of 'cnt' segments to a file opened with
+ * O_DIRECT, through an aligned bounce buffer. The last chunk is
+ * padded and the file truncated afterwards.
+ * RETURNS: 0 on success, -1 on failure (errno set; EINVAL if
+ *          the file system doesn't support direct I/O).
+ */
+static int
+writeDirect(int fd, const struct iovec *iov, int cnt, unsigned long total)
+{
+void          *bounce;
+struct iovec   sub[IOV_CHUNK];
+unsigned long  off, want, fill, l, pad;
+int            i, k, put, rval = -1;
+
+	if ( (errno = posix_memalign(&bounce, UNCACHED_ALIGN, UNCACHED_CHUNK)) )
+		return -1;
+
+	for ( off = 0; off < total; off += want ) {
+		if ( (want = total - off) > UNCACHED_CHUNK )
+			want = UNCACHED_CHUNK;
+		for ( fill = 0; fill < want; ) {
+			l = want - fill;
+			k = iovSlice(iov, cnt, off + fill, &l, sub);
+			for ( i = 0; i < k; i++ ) {
+				memcpy((char*)bounce + fill, sub[i].iov_base, sub[i].iov_len);
+				fill += sub[i].iov_len;
+			}
+		}
+		pad = (UNCACHED_ALIGN - want % UNCACHED_ALIGN) % UNCACHED_ALIGN;
+		memset((char*)bounce + want, 0, pad);
+		while ( (put = write(fd, bounce, want + pad)) < 0 && EINTR == errno )
+			/* retry */;
+		if ( put != want + pad ) {
+			if ( put >= 0 )
+				errno = EIO;
+			goto bail;
+		}
 	}
+	if ( total % UNCACHED_ALIGN && ftruncate(fd, total) )
+		goto bail;
+	rval = 0;
 
-	rval = (rbuf - (char*)buf)/sizeof(*buf);
-	
-cleanup:
-	free(s);
-	if ( fd > -1 )
-		close(fd);
+bail:
+	free(bounce);
 	return rval;
 }
+#endif
 
-#ifndef NO_EPICS
+/* Write 'total' bytes of 'cnt' segments through the page cache
+ * but flush and drop every chunk once it is written so that only
+ * a few chunks are ever cached.
+ * RETURNS: 0 on success, -1 on failure (errno set).
+ */
+static int
+writeDropBehind(int fd, const struct iovec *iov, int cnt, unsigned long total)
+{
+struct iovec   sub[IOV_CHUNK];
+unsigned long  off, l;
+int            k;
 
-#define DEFAULT_PATH "/dat"
+	for ( off = 0; off < total; off += l ) {
+		if ( (l = total - off) > UNCACHED_CHUNK )
+			l = UNCACHED_CHUNK;
+		k = iovSlice(iov, cnt, off, &l, sub);
+		if ( writeAll(fd, sub, k) )
+			return -1;
+#ifdef SYNC_FILE_RANGE_WRITE
+		/* start write-back of this chunk; wait for the previous one */
+		sync_file_range(fd, off, l, SYNC_FILE_RANGE_WRITE);
+		if ( off > 0 ) {
+			sync_file_range(fd, 0, off, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			cacheHint(fd, 0, off, 1);
+		}
+#endif
+	}
+	/* pages must be clean before they can be dropped */
+	if ( fdatasync(fd) )
+		return -1;
+	cacheHint(fd, 0, 0, 1);
+	return 0;
+}
 
-static int sizes[] = {  0 /* string */,
-						sizeof(signed char),  sizeof(unsigned char), 
-						sizeof(signed short), sizeof(unsigned short), 
-						sizeof(signed long),  sizeof(unsigned long), 
-						sizeof(float),        sizeof(double),
-						/* xxx enum */ };
+/* Names are looked up relative to the directory open on 'dfd'
+ * if openat & friends are available; with 'dfd' < 0 they are
+ * ordinary (full) path names.
+ */
+static int
+openAt(int dfd, const char *nam, int flags, mode_t mode)
+{
+#ifdef HAS_OPENAT
+	if ( dfd >= 0 )
+		return openat(dfd, nam, flags, mode);
+#endif
+	return open(nam, flags, mode);
+}
 
-static char *gpath()
+static int
+unlinkAt(int dfd, const char *nam)
 {
-char             *path = getenv("DATA_PATH");
-struct stat      sbuf;
-	if ( !path && !stat(DEFAULT_PATH, &sbuf) && S_ISDIR(sbuf.st_mode) )
-		path = DEFAULT_PATH;
-	return path;
+#ifdef HAS_OPENAT
+	if ( dfd >= 0 )
+		return unlinkat(dfd, nam, 0);
+#endif
+	return unlink(nam);
 }
 
+static int
+renameAt(int dfd, const char *from, const char *to)
+{
+#ifdef HAS_OPENAT
+	if ( dfd >= 0 )
+		return renameat(dfd, from, dfd, to);
+#endif
+	return rename(from, to);
+}
 
-static void writer(void *arg)
+/* make renames in 'path' durable; errors are ignored
+ * since not all systems allow for syncing directories.
+ */
+static void
+savresSyncDir(char *path)
 {
-struct aaoRecord *paao;
-char             *path = gpath();
+int fd;
 
-	do {
-		epicsMessageQueueReceive( aaoSavResQId, &paao, sizeof(paao) );
+	if ( (fd = open(path ? path : ".", O_RDONLY)) >= 0 ) {
+		fsync(fd);
+		close(fd);
+	}
+}
 
-		/* ignore invalid ftvl and write errors */
-		if ( paao->ftvl > 0 && paao->ftvl < sizeof(sizes)/sizeof(sizes[0]) ) {
-			savresDumpData(path, paao->name, paao->bptr, paao->nelm * sizes[paao->ftvl]);
-		}
+static int
+linkAt(int dfd, const char *from, const char *to)
+{
+#ifdef HAS_OPENAT
+	if ( dfd >= 0 )
+		return linkat(dfd, from, dfd, to, 0);
+#endif
+	return link(from, to);
+}
 
-		/* aao can't do async processing :-( */
-#if 0
-		dbScanLock( (dbCommon*)paao );
-		(*paao->rset->process)((dbCommon*)paao);
-		dbScanUnlock( (dbCommon*)paao );
+static int
+mkdirAt(int dfd, const char *nam)
+{
+#ifdef HAS_OPENAT
+	if ( dfd >= 0 )
+		return mkdirat(dfd, nam, 0777);
+#endif
+#ifdef vxWorks
+	return mkdir((char*)nam);
+#else
+	return mkdir(nam, 0777);
 #endif
-	} while (1);
 }
 
-/* schedule asynchronous dumping of record data;
- * record is processed again (2nd phase) when
- * writing completes.
- * 
- * This routine sets PACT.
+/* Create the 'lvl' hashed directories leading to 'nam' (i.e.,
+ * the last 'lvl' directories of its path).
+ * RETURNS: 0 on success, -1 on failure (errno set).
  */
-int
-aaoDumpDataAsync(struct aaoRecord *paao)
+static int
+mkShardDirs(int dfd, const char *nam, int lvl)
 {
-int rval;
-	rval = epicsMessageQueueSend( aaoSavResQId, &paao, sizeof(paao) );
-	/* aao doesn't allow for async processing :-(.
-	 * So we just asynchronously write the data out.
-	 */
-#if 0
-	if ( id ) {
-		paao->pact = TRUE;
+char *s, *p;
+char *sep[SAVRES_SHARD_MAX];
+int  i, n;
+
+	if ( ! (s = mkfnamLvl(0, (char*)nam, 0, 0)) )
+		return -1;
+	/* the last 'lvl' separators end the directories to make */
+	for ( n = 0, p = s + strlen(s); p > s && n < lvl; ) {
+		if ( '/' == *--p )
+			sep[n++] = p;
 	}
-#endif
-	return rval;
+	for ( i = n - 1; i >= 0; i-- ) {
+		*sep[i] = 0;
+		if ( mkdirAt(dfd, s) && EEXIST != errno ) {
+			free(s);
+			return -1;
+		}
+		*sep[i] = '/';
+	}
+	free(s);
+	return 0;
 }
 
-int
-aaoRstrData(struct aaoRecord *paao)
+/* openAt for creating 'nam' which is 'lvl' levels deep in the
+ * hashed layout; missing directories are made.
+ */
+static int
+createAt(int dfd, const char *nam, int lvl, int flags, mode_t mode)
 {
-int  rval;
-char *path = gpath();
-
-	/* try lazy init; this is usually called by single-threaded iocInit() during record init phase */
-	if ( !aaoSavResQId )
-		aaoSavResInit();
+int fd;
 
-	rval = savresRstrData(path, paao->name, paao->bptr, paao->nelm*sizes[paao->ftvl]);
-	if ( rval > 0 ) {
-		paao->udf  = 0;
-		recGblResetAlarms(paao);
+	if ( (fd = openAt(dfd, nam, flags, mode)) < 0 && ENOENT == errno && lvl > 0 ) {
+		if ( ! mkShardDirs(dfd, nam, lvl) )
+			fd = openAt(dfd, nam, flags, mode);
 	}
-	return rval;
+	return fd;
 }
 
-int 
-aaoSavResInit()
+/* Open the existing file 'nam' ('lvl' levels deep). If there
+ * is none, try 'flat' (its name in the flat layout or NULL)
+ * and move that file to its proper place on the way; it is
+ * left where it is if this fails.
+ * RETURNS: descriptor or -1 (errno set).
+ */
+static int
+openData(int dfd, const char *nam, int lvl, const char *flat, int flags)
 {
-	assert ( aaoSavResQId = epicsMessageQueueCreate(10, sizeof(struct aaoRecord*)) );
-	assert ( epicsThreadCreate("aaoDataDumper", epicsThreadPriorityLow, epicsThreadGetStackSize(epicsThreadStackSmall), writer, 0) );
-	return 0;
+int fd;
+
+	if ( (fd = openAt(dfd, nam, flags, 0)) >= 0 || ENOENT != errno || ! flat )
+		return fd;
+	if ( (fd = openAt(dfd, flat, flags, 0)) < 0 )
+		return fd;
+	/* link + unlink never replaces a (newer) file */
+	if ( ! mkShardDirs(dfd, nam, lvl) && ! linkAt(dfd, flat, nam) )
+		unlinkAt(dfd, flat);
+	return fd;
 }
-#endif
 
-#ifdef TESTING
-#define NN 10
+/* make renames in the directory holding 'nam' durable; errors
+ * are ignored since not all systems allow for syncing directories.
+ */
+static void
+syncParent(int dfd, const char *nam)
+{
+const char *p = strrchr(nam, '/');
+char       *d;
+int        fd;
 
-float f1[NN];
-float f2[NN];
+	if ( ! p ) {
+		if ( dfd >= 0 )
+			fsync(dfd);
+		else
+			savresSyncDir(0);
+		return;
+	}
+	if ( ! (d = malloc(p - nam + 2)) )
+		return;
+	/* root is '/' */
+	memcpy(d, nam, p - nam + ( p == nam ));
+	d[p - nam + ( p == nam )] = 0;
+	if ( (fd = openAt(dfd, d, O_RDONLY, 0)) >= 0 ) {
+		fsync(fd);
+		close(fd);
+	}
+	free(d);
+}
 
-static void rchk(char *path, char *fnam, float *orig, float *buf, int n, int nmax)
+/* write 'cnt' segments to the temporary file 'tmp' ('lvl'
+ * levels deep in the hashed layout);
+ * if 'dosync' is set the data are flushed to stable storage
+ * before the file is closed. The temporary file is removed
+ * if anything goes wrong.
+ */
+static int
+dumpTmpAt(int dfd, const char *tmp, int lvl, const struct iovec *iov, int cnt, int dosync)
 {
-int i;
-	for ( i=0; i<nmax; i++ )
-		buf[i]=0.0;
-	if ( savresRstrData(path,fnam, (char*)buf, nmax * sizeof(*buf)) < 0 ) {
-		errlogPrintf("Restoring [%i] failure\n", n);
-		exit(1);
+int           rval  = -1;
+int           fd    = -1;
+unsigned long total = 0;
+int           i, st;
+
+	for ( i = 0; i < cnt; i++ )
+		total += iov[i].iov_len;
+
+#ifdef O_DIRECT
+	if ( uncached(total) && (fd=createAt(dfd,tmp,lvl,O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT,0777)) >= 0 ) {
+		if ( 0 == (st = writeDirect(fd, iov, cnt, total)) || EINVAL != errno )
+			goto written;
+		/* not supported by this file system */
+		close(fd);
 	}
-	for (i=0; i<n; i++) {
-		if ( orig[i]!=buf[i] ) {
-			errlogPrintf("Restoring [%i]; comparison failure @ %i\n", n, i);
-			exit(1);
-		}
+#endif
+
+	if ( (fd=createAt(dfd,tmp,lvl,O_WRONLY|O_CREAT|O_TRUNC,0777)) < 0 ) {
+		errlogPrintf("savresDumpData; unable to open file for writing: %s\n", strerror(errno));
+		goto cleanup;
+	}
+
+	if ( uncached(total) )
+		st = writeDropBehind(fd, iov, cnt, total);
+	else
+		st = writeAll(fd, iov, cnt);
+
+#ifdef O_DIRECT
+written:
+#endif
+	if ( st ) {
+		errlogPrintf("savresDumpData; error writing data: %s\n", strerror(errno));
+		goto cleanup;
+	}
+
+	if ( dosync && fsync(fd) ) {
+		errlogPrintf("savresDumpData; unable to sync data: %s\n", strerror(errno));
+		goto cleanup;
 	}
-	for (i=n; i<nmax; i++) {
-		if ( buf[i] != 0. ) {
-			errlogPrintf("Restoring [%i]; zero comparison failure @ %i\n", n, i);
-			exit(1);
+
+	rval = 0;
+
+cleanup:
+	if ( fd > -1 )
+		close(fd);
+	if ( rval ) {
+		if ( unlinkAt(dfd, tmp) ) {
+			errlogPrintf("savresDumpData; WARNING: unable to remove bogus file: %s\n", strerror(errno));
 		}
 	}
+	return rval;
 }
 
-
-int main(int argc, char **argv)
+#ifndef NO_EPICS
+/* flush a file written w/o 'dosync' (by the writer's batch commit) */
+static int
+syncAt(int dfd, const char *nam)
 {
-int i;
-	if ( argc < 2 ) {
-		fprintf(stderr,"Need <filename> arg\n");
-		exit(2);
+int  rval = -1;
+int  fd;
+
+	if ( (fd = openAt(dfd, nam, O_WRONLY, 0)) >= 0 ) {
+		rval = fsync(fd);
+		close(fd);
 	}
-	for ( i=0;  i<NN; i++ ) {
-		f1[i]=(float)i;
+	if ( rval )
+		errlogPrintf("savresDumpData; unable to sync %s: %s\n", nam, strerror(errno));
+	return rval;
+}
+#endif
+
+/* atomically replace 'nam' by its temporary file 'tmp' */
+static int
+commitAt(int dfd, const char *nam, const char *tmp)
+{
+int  rval;
+
+	if ( (rval = renameAt(dfd, tmp, nam)) && EEXIST == errno ) {
+		/* some file systems (dosFs) refuse to replace an existing file */
+		unlinkAt(dfd, nam);
+		rval = renameAt(dfd, tmp, nam);
 	}
-	if ( savresDumpData(0, argv[1], (char*)f1, NN*sizeof(f1[0])) ) {
-		fprintf(stderr,"Saving failure\n");
-		exit(1);
+	if ( rval ) {
+		errlogPrintf("savresDumpData; unable to rename %s: %s\n", tmp, strerror(errno));
+		unlinkAt(dfd, tmp);
 	}
-	rchk(".",argv[1],f1,f2,NN,NN);
-	if ( savresDumpData(0, argv[1], (char*)f1, 5*sizeof(f1[0])) ) {
-		fprintf(stderr,"Saving failure\n");
-		exit(1);
+	return rval;
+}
+
+#ifndef NO_EPICS
+/* Flush everything written to the file system holding 'path'
+ * (used by the writer's batch commit).
+ * RETURNS: 0 on success, -1 if this is not supported (the
+ *          caller must then sync the files individually).
+ */
+static int
+savresSyncFs(char *path)
+{
+#ifdef SYS_syncfs
+int rval = -1;
+int fd;
+
+	if ( (fd = open(path ? path : ".", O_RDONLY)) >= 0 ) {
+		rval = syscall(SYS_syncfs, fd);
+		close(fd);
 	}
-	rchk(".",argv[1],f1,f2,5, NN);
+	return rval;
+#else
+	return -1;
+#endif
+}
+#endif
+
+static int
+dumpFileV(char *path, char *fnam, const struct iovec *iov, int cnt)
+{
+int  dosync = ( savresDurability > SAVRES_DURABLE_NONE );
+int  rval   = -1;
+char *s     = mkfnam(path,fnam,0);
+char *t     = mkfnam(path,fnam,TMP_SUFFIX);
+
+	if ( s && t && ! dumpTmpAt(-1, t, shardLevels(fnam), iov, cnt, dosync) && ! commitAt(-1, s, t) ) {
+		if ( dosync )
+			syncParent(-1, s);
+		rval = 0;
+	}
+	free(s);
+	free(t);
+	return rval;
+}
+
+static int
+dumpFile(char *path, char *fnam, char *hdr, int hlen, char *buf, int n)
+{
+struct iovec iov[2];
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len  = hlen;
+	iov[1].iov_base = buf;
+	iov[1].iov_len  = n;
+	return dumpFileV(path, fnam, iov, 2);
+}
+
+int
+savresDumpData(char *path, char *fnam, char *buf, int n)
+{
+	return dumpFile(path, fnam, 0, 0, buf, n);
+}
+
+int
+savresDumpDataV(char *path, char *fnam, const struct iovec *iov, int iovcnt)
+{
+	return dumpFileV(path, fnam, iov, iovcnt);
+}
+
+int
+savresDumpDataPacked(char *path, char *fnam, char *buf, int n, int codec, int esz)
+{
+char          *p;
+unsigned long  l;
+int            rval;
+
+	if ( SAVRES_CODEC_NONE == codec )
+		return savresDumpData(path, fnam, buf, n);
+
+	if ( ! (p = malloc(n + SAVRES_PACK_WORK(n))) ) {
+		errlogPrintf("savresDumpDataPacked: no memory\n");
+		return -1;
+	}
+	if ( (l = savresPack(p, buf, n, codec, esz, p + n)) )
+		rval = savresDumpData(path, fnam, p, l);
+	else
+		rval = savresDumpData(path, fnam, buf, n);
+	free(p);
+	return rval;
+}
+
+int
+savresDumpDataTyped(char *path, char *fnam, char *buf, int nelm, int type, int codec)
+{
+char          hdr[SAVRES_FILE_HDR];
+char          *p = 0;
+unsigned long  n, l = 0;
+int            esz, rval;
+
+	if ( ! (esz = savresTypeSize(type)) ) {
+		errlogPrintf("savresDumpDataTyped: invalid type %i\n", type);
+		return -1;
+	}
+	n = nelm * esz;
+
+	if ( SAVRES_CODEC_NONE != codec ) {
+		if ( ! (p = malloc(n + SAVRES_PACK_WORK(n))) ) {
+			errlogPrintf("savresDumpDataTyped: no memory\n");
+			return -1;
+		}
+		l = savresPack(p, buf, n, codec, esz, p + n);
+	}
+	if ( l ) {
+		savresMkHdr(hdr, type, nelm, codec, p, l);
+		rval = dumpFile(path, fnam, hdr, sizeof(hdr), p, l);
+	} else {
+		/* doesn't shrink */
+		savresMkHdr(hdr, type, nelm, SAVRES_CODEC_NONE, buf, n);
+		rval = dumpFile(path, fnam, hdr, sizeof(hdr), buf, n);
+	}
+	free(p);
+	return rval;
+}
+
+/* Incremental saves. A delta object remembers a 64-bit hash
+ * of every SAVRES_DELTA_BLK-sized block of the data which are
+ * known to be in the file. A save of identical data can thus
+ * be skipped and otherwise only the blocks which changed need
+ * to be rewritten.
+ */
+struct SavResDeltaRec_ {
+	unsigned long       max;     /* max. number of bytes       */
+	unsigned long       n;       /* bytes known to be on disk  */
+	int                 valid;
+	unsigned long       nblk;
+	unsigned long long *hash;    /* on disk                    */
+	unsigned long long *nhash;   /* of the data being saved    */
+};
+
+/* a simple multiplicative hash over 64-bit words */
+static unsigned long long
+blkHash(const char *p, unsigned long n)
+{
+unsigned long long h = 0x9e3779b97f4a7c15ULL ^ n;
+unsigned long long w;
+
+	for ( ; n >= sizeof(w); n -= sizeof(w), p += sizeof(w) ) {
+		memcpy(&w, p, sizeof(w));
+		h  = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	if ( n ) {
+		w = 0;
+		memcpy(&w, p, n);
+		h  = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+	}
+	h ^= h >> 29;
+	return h;
+}
+
+SavResDelta
+savresDeltaCreate(int n)
+{
+SavResDelta d;
+
+	if ( ! (d = calloc(1, sizeof(*d))) )
+		return 0;
+	d->max  = n;
+	d->nblk = (n + SAVRES_DELTA_BLK - 1) / SAVRES_DELTA_BLK;
+	if ( ! (d->hash = malloc( 2 * (d->nblk ? d->nblk : 1) * sizeof(*d->hash) )) ) {
+		free(d);
+		return 0;
+	}
+	d->nhash = d->hash + d->nblk;
+	return d;
+}
+
+void
+savresDeltaDestroy(SavResDelta d)
+{
+	if ( d ) {
+		free(d->hash);
+		free(d);
+	}
+}
+
+void
+savresDeltaInvalidate(SavResDelta d)
+{
+	d->valid = 0;
+}
+
+/* hash 'buf' into 'h' */
+static void
+deltaHash(unsigned long long *h, char *buf, unsigned long n)
+{
+unsigned long i;
+
+	for ( i = 0; n > 0; i++ ) {
+		h[i] = blkHash(buf, n < SAVRES_DELTA_BLK ? n : SAVRES_DELTA_BLK);
+		if ( n < SAVRES_DELTA_BLK )
+			break;
+		n   -= SAVRES_DELTA_BLK;
+		buf += SAVRES_DELTA_BLK;
+	}
+}
+
+void
+savresDeltaSet(SavResDelta d, char *buf, int n)
+{
+	if ( n > d->max ) {
+		d->valid = 0;
+		return;
+	}
+	deltaHash(d->hash, buf, n);
+	d->n     = n;
+	d->valid = 1;
+}
+
+int
+savresDeltaCompare(SavResDelta d, char *buf, int n)
+{
+unsigned long i, nb;
+int           rval = 0;
+
+	if ( n > d->max )
+		return -1;
+
+	deltaHash(d->nhash, buf, n);
+
+	if ( ! d->valid || n != d->n )
+		return -1;
+
+	nb = (n + SAVRES_DELTA_BLK - 1) / SAVRES_DELTA_BLK;
+	for ( i = 0; i < nb; i++ ) {
+		if ( d->hash[i] != d->nhash[i] )
+			rval++;
+	}
+	return rval;
+}
+
+void
+savresDeltaCommit(SavResDelta d, int n)
+{
+unsigned long long *t = d->hash;
+
+	d->hash  = d->nhash;
+	d->nhash = t;
+	d->n     = n;
+	d->valid = 1;
+}
+
+static long
+deltaPut(int fd, char *buf, unsigned long n, off_t off)
+{
+#if defined(__rtems__) || defined(vxWorks)
+	/* no pwrite; the descriptor is private, though */
+	if ( lseek(fd, off, SEEK_SET) < 0 )
+		return -1;
+	return write(fd, buf, n);
+#else
+	return pwrite(fd, buf, n, off);
+#endif
+}
+
+int
+savresDeltaWrite(char *path, char *fnam, char *buf, int n, SavResDelta d, int dosync)
+{
+	return savresDeltaWriteHdr(path, fnam, 0, 0, buf, n, d, dosync);
+}
+
+/* savresDeltaWriteHdr for the file 'nam' (see openAt) */
+static int
+deltaWriteAt(int dfd, const char *nam, char *hdr, int hlen, char *buf, int n, SavResDelta d, int dosync)
+{
+int           rval = -1;
+int           fd   = -1;
+unsigned long i, j, nb, off, len;
+long          put;
+struct stat   sb;
+
+	/* file must exist and still be what we think it is */
+	if ( (fd = openAt(dfd, nam, O_WRONLY, 0)) < 0 || fstat(fd, &sb) || sb.st_size != hlen + n )
+		goto cleanup;
+
+	nb = (n + SAVRES_DELTA_BLK - 1) / SAVRES_DELTA_BLK;
+	for ( i = 0; i < nb; i = j ) {
+		if ( d->hash[i] == d->nhash[i] ) {
+			j = i + 1;
+			continue;
+		}
+		/* coalesce runs of changed blocks */
+		for ( j = i + 1; j < nb && d->hash[j] != d->nhash[j]; j++ )
+			;
+		off = i * SAVRES_DELTA_BLK;
+		len = ( j == nb ? (unsigned long)n : j * SAVRES_DELTA_BLK ) - off;
+		while ( len > 0 ) {
+			if ( (put = deltaPut(fd, buf + off, len, hlen + off)) <= 0 ) {
+				if ( put < 0 && EINTR == errno )
+					continue;
+				goto bail;
+			}
+			off += put;
+			len -= put;
+		}
+	}
+
+	/* header last */
+	for ( off = 0; off < (unsigned long)hlen; off += put ) {
+		if ( (put = deltaPut(fd, hdr + off, hlen - off, off)) <= 0 ) {
+			if ( put < 0 && EINTR == errno ) {
+				put = 0;
+				continue;
+			}
+			goto bail;
+		}
+	}
+
+	if ( dosync && fsync(fd) )
+		goto bail;
+
+	rval = 0;
+
+bail:
+	if ( rval ) {
+		/* file is in an unknown state now */
+		errlogPrintf("savresDeltaWrite; error writing %s: %s\n", nam, strerror(errno));
+		d->valid = 0;
+	}
+
+cleanup:
+	if ( fd > -1 )
+		close(fd);
+	return rval;
+}
+
+int
+savresDeltaWriteHdr(char *path, char *fnam, char *hdr, int hlen, char *buf, int n, SavResDelta d, int dosync)
+{
+char *s = mkfnam(path,fnam,0);
+int  rval;
+
+	if ( !s )
+		return -1;
+	rval = deltaWriteAt(-1, s, hdr, hlen, buf, n, d, dosync);
+	free(s);
+	return rval;
+}
+
+int
+savresDumpDataDelta(char *path, char *fnam, char *buf, int n, SavResDelta d)
+{
+int dosync = ( savresDurability > SAVRES_DURABLE_NONE );
+int nchg;
+
+	if ( 0 == (nchg = savresDeltaCompare(d, buf, n)) )
+		return 1;
+
+	if ( nchg < 0 || savresDeltaWrite(path, fnam, buf, n, d, dosync) ) {
+		if ( savresDumpData(path, fnam, buf, n) ) {
+			d->valid = 0;
+			return -1;
+		}
+	}
+	savresDeltaCommit(d, n);
+	return 0;
+}
+
+/* copy 'n' bytes; big blocks bypass the cache (where supported)
+ * so that restoring huge arrays doesn't evict everything else.
+ */
+void
+savresCopy(char *dst, const char *src, unsigned long n)
+{
+#ifdef __SSE2__
+__m128i a, b, c, d;
+
+	if ( n >= NT_COPY_MIN ) {
+		while ( ((unsigned long)dst & 15) ) {
+			*dst++ = *src++;
+			n--;
+		}
+		for ( ; n >= 64; n -= 64, src += 64, dst += 64 ) {
+			a = _mm_loadu_si128( (const __m128i*)src + 0 );
+			b = _mm_loadu_si128( (const __m128i*)src + 1 );
+			c = _mm_loadu_si128( (const __m128i*)src + 2 );
+			d = _mm_loadu_si128( (const __m128i*)src + 3 );
+			_mm_stream_si128( (__m128i*)dst + 0, a );
+			_mm_stream_si128( (__m128i*)dst + 1, b );
+			_mm_stream_si128( (__m128i*)dst + 2, c );
+			_mm_stream_si128( (__m128i*)dst + 3, d );
+		}
+		_mm_sfence();
+	}
+#endif
+	memcpy(dst, src, n);
+}
+
+/* Map 'len' bytes at 'off' of an open file read-only; if
+ * mapping is not possible the data are read into a buffer.
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresViewMap(int fd, off_t off, unsigned long len, SavResView v)
+{
+char *rbuf;
+long  got;
+#ifdef HAS_MMAP
+off_t pgoff;
+void *m;
+#endif
+
+	if ( uncached(len) )
+		cacheHint(fd, off, len, 0);
+
+	v->type = SAVRES_TYPE_RAW;
+	v->esz  = 0;
+	v->nelm = 0;
+
+#ifdef HAS_MMAP
+	/* mmap wants a page-aligned offset */
+	pgoff = off & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+	if ( len > 0 && MAP_FAILED != (m = mmap(0, len + (off - pgoff), PROT_READ, MAP_SHARED, fd, pgoff)) ) {
+		v->base   = m;
+		v->mlen   = len + (off - pgoff);
+		v->mapped = 1;
+		v->data   = (char*)m + (off - pgoff);
+		v->n      = len;
+		return 0;
+	}
+	/* fall back to reading */
+#endif
+
+	if ( ! (v->base = malloc(len ? len : 1)) ) {
+		errlogPrintf("savresViewMap: no memory\n");
+		return -1;
+	}
+	v->mapped = 0;
+	v->mlen   = len;
+	v->data   = v->base;
+	v->n      = len;
+
+	if ( lseek(fd, off, SEEK_SET) < 0 ) {
+		errlogPrintf("savresViewMap: unable to seek: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	for ( rbuf = v->base; len > 0; len -= got, rbuf += got ) {
+		if ( (got = read(fd, rbuf, len)) <= 0 ) {
+			if ( got < 0 && EINTR == errno ) {
+				got = 0;
+				continue;
+			}
+			goto bail;
+		}
+	}
+	return 0;
+
+bail:
+	errlogPrintf("savresViewMap: error reading data: %s\n", got < 0 ? strerror(errno) : "premature EOF");
+fail:
+	free(v->base);
+	v->base = 0;
+	return -1;
+}
+
+void
+savresUnmapData(SavResView v)
+{
+	if ( v->base ) {
+#ifdef HAS_MMAP
+		if ( v->mapped )
+			munmap(v->base, v->mlen);
+		else
+#endif
+			free(v->base);
+	}
+	v->base = 0;
+	v->data = 0;
+	v->n    = 0;
+}
+
+int
+savresOpenData(char *path, char *fnam)
+{
+int  lvl = shardLevels(fnam);
+char *s  = mkfnam(path,fnam,0);
+char *f  = lvl ? mkfnamLvl(path,fnam,0,0) : 0;
+int  fd  = -1;
+
+	if ( s && ( f || ! lvl ) )
+		fd = openData(-1, s, lvl, f, O_RDONLY);
+	else
+		errno = ENOMEM;
+	free(s);
+	free(f);
+	return fd;
+}
+
+int
+savresMapData(char *path, char *fnam, SavResView v)
+{
+int         rval = -1;
+int         fd   = -1;
+struct stat sb;
+
+	memset(v, 0, sizeof(*v));
+
+	if ( (fd=savresOpenData(path,fnam)) < 0 ) {
+		errlogPrintf("savresMapData; unable to open file for reading: %s\n", strerror(errno));
+		goto cleanup;
+	}
+
+	if ( fstat(fd, &sb) ) {
+		errlogPrintf("savresMapData; unable to stat file: %s\n", strerror(errno));
+		goto cleanup;
+	}
+
+	if ( ! savresViewMap(fd, 0, sb.st_size, v) ) {
+		if ( savresViewDecode(v) )
+			savresUnmapData(v);
+		else
+			rval = v->n;
+	}
+
+cleanup:
+	if ( fd > -1 )
+		close(fd);
+	return rval;
+}
+
+/* restore up to 'n' bytes from the file open on 'fd' (positioned
+ * at 0); see savresRstrData. Data with a header must hold 'nelm'
+ * elements of 'type' (see savresDecodeTyped).
+ */
+static int
+rstrFd(int fd, char *buf, int n, int type, unsigned long nelm, const char *nam)
+{
+int  rval = -1;
+int  got,i;
+char *rbuf;
+struct stat   sb;
+SavResViewRec v;
+char          hdr[SAVRES_FILE_HDR];
+
+	i    = n*sizeof(*buf);
+
+	if ( fstat(fd, &sb) )
+		sb.st_size = 0;
+
+	/* header or compressed? */
+	if ( sb.st_size >= SAVRES_PACK_HDR && i > 0 ) {
+		for ( rbuf = hdr; rbuf < hdr + sizeof(hdr); rbuf += got ) {
+			if ( (got = read(fd, rbuf, hdr + sizeof(hdr) - rbuf)) <= 0 )
+				break;
+		}
+		if ( savresIsEncoded(hdr, rbuf - hdr) ) {
+			if ( ! savresViewMap(fd, 0, sb.st_size, &v) ) {
+				rval = savresDecodeTyped(buf, i, v.data, v.n, type, nelm, nam);
+				savresUnmapData(&v);
+			}
+			goto done;
+		}
+		if ( lseek(fd, 0, SEEK_SET) < 0 ) {
+			errlogPrintf("savresRstrData; unable to seek: %s\n", strerror(errno));
+			goto done;
+		}
+	}
+
+#ifdef HAS_MMAP
+	/* big files are mapped and copied in one go */
+	if ( sb.st_size >= MMAP_MIN && i >= MMAP_MIN ) {
+		if ( sb.st_size < i )
+			i = sb.st_size;
+		if ( ! savresViewMap(fd, 0, i, &v) ) {
+			savresCopy(buf, v.data, i);
+			savresUnmapData(&v);
+			rval = i/sizeof(*buf);
+			goto done;
+		}
+		i = n*sizeof(*buf);
+	}
+#endif
+
+	if ( uncached(sb.st_size) )
+		cacheHint(fd, 0, sb.st_size, 0);
+
+	rbuf = (char*)buf; 
+	/* read(x,y,0) returns 0 */
+	while ( (got = read(fd, rbuf, i)) > 0 ) {
+		rbuf += got;
+		i    -= got;
+	}
+
+	if ( got < 0 ) {
+		errlogPrintf("savresRstrData; error reading data: %s\n", strerror(errno));
+		goto done;
+	}
+
+	rval = (rbuf - (char*)buf)/sizeof(*buf);
+	
+done:
+	/* the record holds the data now */
+	if ( uncached(sb.st_size) )
+		cacheHint(fd, 0, 0, 1);
+	return rval;
+}
+
+static int
+rstrPath(char *path, char *fnam, char *buf, int n, int type, unsigned long nelm)
+{
+int  rval = -1;
+int  fd;
+
+	if ( (fd=savresOpenData(path,fnam)) < 0 ) {
+		errlogPrintf("savresRstrData; unable to open file for reading: %s\n", strerror(errno));
+	} else {
+		rval = rstrFd(fd, buf, n, type, nelm, fnam);
+		close(fd);
+	}
+	return rval;
+}
+
+int
+savresRstrData(char *path, char *fnam, char *buf, int n)
+{
+	return rstrPath(path, fnam, buf, n, SAVRES_TYPE_RAW, 0);
+}
+
+int
+savresRstrDataV(char *path, char *fnam, const struct iovec *iov, int iovcnt)
+{
+int           rval = -1;
+int           fd   = -1;
+int           i;
+long          got, l;
+char          *rbuf;
+struct stat   sb;
+SavResViewRec v;
+char          hdr[SAVRES_FILE_HDR];
+
+	if ( (fd=savresOpenData(path,fnam)) < 0 ) {
+		errlogPrintf("savresRstrDataV; unable to open file for reading: %s\n", strerror(errno));
+		goto cleanup;
+	}
+
+	if ( fstat(fd, &sb) )
+		sb.st_size = 0;
+
+	/* header or compressed? Such data must be decoded and
+	 * are then scattered into the segments.
+	 */
+	if ( sb.st_size >= SAVRES_PACK_HDR ) {
+		for ( rbuf = hdr; rbuf < hdr + sizeof(hdr); rbuf += got ) {
+			if ( (got = read(fd, rbuf, hdr + sizeof(hdr) - rbuf)) <= 0 )
+				break;
+		}
+		if ( savresIsEncoded(hdr, rbuf - hdr) ) {
+			if ( ! savresViewMap(fd, 0, sb.st_size, &v) ) {
+				if ( ! savresViewDecode(&v) ) {
+					for ( i = 0, rval = 0; i < iovcnt && rval < v.n; i++ ) {
+						if ( (l = iov[i].iov_len) > v.n - rval )
+							l = v.n - rval;
+						savresCopy(iov[i].iov_base, v.data + rval, l);
+						rval += l;
+					}
+				}
+				savresUnmapData(&v);
+			}
+			goto cleanup;
+		}
+#ifndef HAS_PREADV
+		if ( lseek(fd, 0, SEEK_SET) < 0 ) {
+			errlogPrintf("savresRstrDataV; unable to seek: %s\n", strerror(errno));
+			goto cleanup;
+		}
+#endif
+	}
+
+	if ( uncached(sb.st_size) )
+		cacheHint(fd, 0, sb.st_size, 0);
+
+	if ( (got = readAll(fd, iov, iovcnt)) < 0 ) {
+		errlogPrintf("savresRstrDataV; error reading data: %s\n", strerror(errno));
+		goto cleanup;
+	}
+	rval = got;
+
+cleanup:
+	if ( fd > -1 ) {
+		if ( uncached(sb.st_size) )
+			cacheHint(fd, 0, 0, 1);
+		close(fd);
+	}
+	return rval;
+}
+
+/* Handles. Names are relative to 'dfd' or, if openat is not
+ * available, full path names. The asynchronous writer shares
+ * one directory descriptor among all of its records.
+ */
+typedef struct SavResHandleRec_ {
+	int           dfd;
+	int           ownDfd;
+	int           lvl;    /* hashed directory levels */
+	char         *nam;
+	char         *tmp;
+	char         *flat;   /* name in the flat layout if 'lvl' > 0 */
+	int           fd;     /* kept-open file or -1 */
+	unsigned long len;    /* its length; ~0 if unknown */
+} SavResHandleRec;
+
+/* RETURNS: descriptor of directory 'path' or -1 (names
+ *          must then be full paths).
+ */
+static int
+dirOpen(char *path)
+{
+#ifdef HAS_OPENAT
+	return open(path ? path : ".", O_RDONLY|O_DIRECTORY);
+#else
+	return -1;
+#endif
+}
+
+static void
+handleClean(SavResHandle h)
+{
+	if ( h->fd > -1 )
+		close(h->fd);
+	if ( h->ownDfd && h->dfd > -1 )
+		close(h->dfd);
+	free(h->nam);
+	free(h->tmp);
+	free(h->flat);
+	memset(h, 0, sizeof(*h));
+	h->fd  = -1;
+	h->dfd = -1;
+}
+
+/* Set up a handle for '<path>/<fnam>' relative to 'dfd'
+ * (which is not closed by handleClean).
+ * RETURNS: 0 on success, -1 if there is no memory.
+ */
+static int
+handleInit(SavResHandle h, int dfd, char *path, char *fnam)
+{
+	memset(h, 0, sizeof(*h));
+	h->fd  = -1;
+	h->dfd = dfd;
+	h->len = ~0UL;
+	h->lvl = shardLevels(fnam);
+	if ( dfd > -1 )
+		path = 0;
+	if ( ! (h->nam = mkfnamLvl(path, fnam, 0, h->lvl)) )
+		goto bail;
+	if ( ! (h->tmp = mkfnamLvl(path, fnam, TMP_SUFFIX, h->lvl)) )
+		goto bail;
+	if ( h->lvl && ! (h->flat = mkfnamLvl(path, fnam, 0, 0)) )
+		goto bail;
+	return 0;
+
+bail:
+	handleClean(h);
+	return -1;
+}
+
+SavResHandle
+savresHandleCreate(char *path, char *fnam, int flags)
+{
+SavResHandle h;
+struct stat  sb;
+int          dfd;
+
+	if ( ! (h = malloc(sizeof(*h))) )
+		return 0;
+
+	/* fall back to full path names if the directory can't be opened */
+	dfd = dirOpen(path);
+	if ( handleInit(h, dfd, path, fnam) ) {
+		if ( dfd > -1 )
+			close(dfd);
+		free(h);
+		return 0;
+	}
+	h->ownDfd = 1;
+
+	if ( (flags & SAVRES_HANDLE_KEEPOPEN) ) {
+		h->fd = openData(h->dfd, h->nam, h->lvl, h->flat, O_RDWR);
+		if ( h->fd < 0 && ENOENT == errno )
+			h->fd = createAt(h->dfd, h->nam, h->lvl, O_RDWR|O_CREAT, 0777);
+		if ( h->fd < 0 ) {
+			errlogPrintf("savresHandleCreate; unable to open %s: %s\n", h->nam, strerror(errno));
+			savresHandleDestroy(h);
+			return 0;
+		}
+		if ( ! fstat(h->fd, &sb) )
+			h->len = sb.st_size;
+	}
+	return h;
+}
+
+void
+savresHandleDestroy(SavResHandle h)
+{
+	if ( h ) {
+		handleClean(h);
+		free(h);
+	}
+}
+
+int
+savresHandleDumpV(SavResHandle h, const struct iovec *iov, int iovcnt)
+{
+int           dosync = ( savresDurability > SAVRES_DURABLE_NONE );
+unsigned long total  = 0;
+int           i;
+
+	if ( h->fd < 0 ) {
+		if ( dumpTmpAt(h->dfd, h->tmp, h->lvl, iov, iovcnt, dosync) || commitAt(h->dfd, h->nam, h->tmp) )
+			return -1;
+		if ( dosync )
+			syncParent(h->dfd, h->nam);
+		return 0;
+	}
+
+	for ( i = 0; i < iovcnt; i++ )
+		total += iov[i].iov_len;
+
+	if ( writeAllAt(h->fd, iov, iovcnt, 0) )
+		goto bail;
+	/* the size of most records never changes */
+	if ( total != h->len ) {
+		if ( ftruncate(h->fd, total) )
+			goto bail;
+		h->len = total;
+	}
+	if ( dosync && fdatasync(h->fd) )
+		goto bail;
+	return 0;
+
+bail:
+	errlogPrintf("savresHandleDump; error writing %s: %s\n", h->nam, strerror(errno));
+	h->len = ~0UL;
+	return -1;
+}
+
+int
+savresHandleDump(SavResHandle h, char *buf, int n)
+{
+struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len  = n;
+	return savresHandleDumpV(h, &iov, 1);
+}
+
+int
+savresHandleRstr(SavResHandle h, char *buf, int n)
+{
+int rval, fd;
+
+	if ( h->fd > -1 ) {
+		if ( lseek(h->fd, 0, SEEK_SET) < 0 )
+			return -1;
+		return rstrFd(h->fd, buf, n, SAVRES_TYPE_RAW, 0, 0);
+	}
+
+	if ( (fd = openData(h->dfd, h->nam, h->lvl, h->flat, O_RDONLY)) < 0 ) {
+		errlogPrintf("savresHandleRstr; unable to open file for reading: %s\n", strerror(errno));
+		return -1;
+	}
+	rval = rstrFd(fd, buf, n, SAVRES_TYPE_RAW, 0, 0);
+	close(fd);
+	return rval;
+}
+
+#ifndef NO_EPICS
+
+#define DEFAULT_PATH "/dat"
+
+/* Map FTVL to the element type recorded in the file
+ * (DBF_LONG is 32 bits even where a 'long' is not).
+ * RETURNS: SAVRES_TYPE_xxx or -1 if unsupported.
+ */
+static int ftvlType(int ftvl)
+{
+	switch ( ftvl ) {
+		case DBF_STRING: return SAVRES_TYPE_STRING;
+		case DBF_CHAR:   return SAVRES_TYPE_CHAR;
+		case DBF_UCHAR:  return SAVRES_TYPE_UCHAR;
+		case DBF_SHORT:  return SAVRES_TYPE_SHORT;
+		case DBF_USHORT: return SAVRES_TYPE_USHORT;
+		case DBF_LONG:   return SAVRES_TYPE_LONG;
+		case DBF_ULONG:  return SAVRES_TYPE_ULONG;
+		case DBF_FLOAT:  return SAVRES_TYPE_FLOAT;
+		case DBF_DOUBLE: return SAVRES_TYPE_DOUBLE;
+		case DBF_ENUM:   return SAVRES_TYPE_ENUM;
+		default:
+		break;
+	}
+	return -1;
+}
+
+/* Atomic primitives used by the (lock-free) submission
+ * path. Targets without gcc's __sync builtins (e.g., m68k)
+ * fall back to epicsInterruptLock() which is cheap on the
+ * uniprocessor systems concerned.
+ */
+#if defined(__GNUC__) && ( __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1) ) && !defined(__m68k__)
+#define membar()             __sync_synchronize()
+#define casInt(p,o,n)        __sync_bool_compare_and_swap((p),(o),(n))
+#define casPtr(p,o,n)        __sync_bool_compare_and_swap((p),(o),(n))
+#define xchgPtr(p,n)         __sync_lock_test_and_set((p),(n))
+#define incUlong(p)          __sync_fetch_and_add((p),1)
+#else
+#define membar()             do {} while (0)
+
+static int casInt(volatile int *p, int o, int n)
+{
+int key = epicsInterruptLock();
+int rval;
+	if ( (rval = (*p == o)) )
+		*p = n;
+	epicsInterruptUnlock(key);
+	return rval;
+}
+
+static int casPtr(void * volatile *p, void *o, void *n)
+{
+int key = epicsInterruptLock();
+int rval;
+	if ( (rval = (*p == o)) )
+		*p = n;
+	epicsInterruptUnlock(key);
+	return rval;
+}
+
+static void *xchgPtr(void * volatile *p, void *n)
+{
+int  key = epicsInterruptLock();
+void *rval = *p;
+	*p = n;
+	epicsInterruptUnlock(key);
+	return rval;
+}
+
+static void incUlong(volatile unsigned long *p)
+{
+int key = epicsInterruptLock();
+	(*p)++;
+	epicsInterruptUnlock(key);
+}
+#endif
+
+/* Per-record bookkeeping. Every record that is dumped
+ * asynchronously owns a slot. A slot is on the writer's
+ * queue at most once ('queued' flag), i.e., a record
+ * that processes faster than the writer can keep up
+ * is coalesced into a single pending job. The writer
+ * always dumps the record's current contents.
+ *
+ * Slots are never removed; the hash table may thus be
+ * searched w/o locking. Only insertion takes slotMtx.
+ *
+ * Unless disabled (savresSnapshot = 0) each slot also
+ * holds two preallocated snapshot buffers. The record's
+ * array is copied into one of them when the dump is
+ * requested (the record is locked at this point) and
+ * the writer only ever looks at this immutable copy.
+ * 'snapState' tells which buffer holds the newest
+ * snapshot ('fresh') and which one is currently being
+ * written ('busy'). The submitter always fills the
+ * buffer which is not busy; no lock is ever held
+ * across I/O.
+ *
+ * Slots with incremental saves enabled ('delta') keep
+ * the block hashes of the data last written; they are
+ * only used by the writer (and by aaoRstrData during
+ * initialization). Incremental saves require snapshots.
+ * 'inPlace' tells that the blocks were rewritten in the
+ * file itself (rather than into a temporary file which
+ * must be renamed when the batch is committed).
+ *
+ * Compressed saves are packed into 'pack' (owned by
+ * the writer) which is allocated on first use.
+ *
+ * With asynchronous I/O a file being written is owned
+ * by 'job' until the writer reaps it ('ioBusy'); the
+ * snapshot (and 'pack', 'hdr') must not be touched
+ * before.
+ *
+ * A slot which is due for saving before its minimum
+ * interval has elapsed is put on the writer's 'deferred'
+ * list. It remains 'queued' while it is waiting there,
+ * i.e., new requests are coalesced and the most recent
+ * data are written when the interval expires.
+ *
+ * 'stats' are updated by the submitter (submits, coalesced,
+ * overflows; the record is locked) and by the writer (all
+ * the others) w/o further locking; readers may thus see
+ * slightly inconsistent figures.
+ */
+typedef struct SavResSlotRec_ {
+	struct SavResSlotRec_ * volatile next;      /* hash chain             */
+	struct SavResSlotRec_          *retryNext; /* overflow list          */
+	struct aaoRecord               *paao;
+	volatile int                    queued;
+	volatile int                    snapState;
+	char                           *snap[2];
+	unsigned long                   nbytes;
+	int                             durability; /* < 0: use global    */
+	int                             inBatch;    /* awaiting commit    */
+	int                             inPlace;
+	int                             delta;      /* < 0: use global    */
+	SavResDelta                     dlt;
+	int                             codec;      /* < 0: use global    */
+	int                             type;       /* SAVRES_TYPE_xxx    */
+	int                             esz;        /* element size       */
+	char                           *pack;
+	char                            hdr[SAVRES_FILE_HDR];
+	int                             rewrite;    /* no in-place update */
+	SavResStatsRec                  stats;
+	double                          tSubmit;
+	SavResAioJobRec                 job;
+	int                             ioBusy;
+	int                             ioDelta;
+	double                          ioStart;
+	double                          minInterval;/* < 0: use global    */
+	double                          lastSave;
+	struct SavResSlotRec_          *deferNext;  /* writer's deferred list */
+	int                             deferred;
+	int                             rstrOrder;  /* < 0: restore at init */
+	volatile int                    rstrPending;
+	volatile int                    rstrRefused;/* save while pending */
+	struct SavResSlotRec_          *rstrNext;   /* deferred restores  */
+	SavResHandleRec                 file;       /* set up by the writer */
+	unsigned                        hash;       /* selects the writer */
+	char                            name[PVNAME_STRINGSZ];
+} SavResSlotRec, *SavResSlot;
+
+#define slotDurability(slot) ( (slot)->durability < 0 ? savresDurability : (slot)->durability )
+#define slotCodec(slot)      ( (slot)->codec < 0 ? savresCodec : (slot)->codec )
+#define slotDelta(slot)      ( ( (slot)->delta < 0 ? savresDelta : (slot)->delta ) && (slot)->snap[0] )
+
+/* snapState encodes buffer index + 1 (0 means 'none') */
+#define SNAP_FRESH(s)     ((s) & 3)
+#define SNAP_BUSY(s)      (((s) >> 2) & 3)
+#define SNAP_STATE(f,b)   ((f) | ((b) << 2))
+
+/* Set to zero to have the writer dump the live
+ * record array (saves memory but the file may
+ * end up with a mix of old and new data).
+ */
+int savresSnapshot = 1;
+epicsExportAddress(int, savresSnapshot);
+
+/* Set to nonzero to enable incremental saves
+ * for all records (savresSetDelta overrides
+ * this for individual records).
+ */
+int savresDelta = 0;
+epicsExportAddress(int, savresDelta);
+
+epicsExportAddress(int, savresCodec);
+
+epicsExportAddress(int, savresDurability);
+epicsExportAddress(int, savresUncachedMin);
+epicsExportAddress(int, savresShardLevels);
+
+#define SLOT_HASH_SIZE 256         /* must be a power of 2   */
+
+static SavResSlot volatile slotTbl[SLOT_HASH_SIZE] = { 0 };
+static epicsMutexId        slotMtx                 = 0;
+
+#define slotHash(nam) ( savresNameHash(nam) & (SLOT_HASH_SIZE - 1) )
+
+static SavResSlot slotFind(const char *nam)
+{
+SavResSlot slot;
+	for ( slot = slotTbl[slotHash(nam)]; slot; slot = slot->next ) {
+		if ( !strcmp(slot->name, nam) )
+			break;
+	}
+	return slot;
+}
+
+static void slotInit()
+{
+	if ( !slotMtx )
+		slotMtx = epicsMutexMustCreate();
+}
+
+/* create a new slot; caller must hold slotMtx */
+static SavResSlot slotCreate(const char *nam)
+{
+SavResSlot slot;
+
+	if ( (slot = calloc(1, sizeof(*slot))) ) {
+		strncpy(slot->name, nam, sizeof(slot->name) - 1);
+		slot->durability = -1;
+		slot->delta      = -1;
+		slot->codec      = -1;
+		slot->minInterval = -1.;
+		slot->rstrOrder  = -1;
+		slot->hash       = savresNameHash(slot->name);
+		slot->next = slotTbl[slotHash(slot->name)];
+		/* slot must be complete before it becomes visible */
+		membar();
+		slotTbl[slotHash(slot->name)] = slot;
+	} else {
+		errlogPrintf("savres: no memory for record slot (%s)\n", nam);
+	}
+	return slot;
+}
+
+/* Find the slot associated with a record name, create a new
+ * one if none exists yet (slots may be set up by configuration
+ * commands before the record is known).
+ */
+static SavResSlot slotLookup(const char *nam)
+{
+SavResSlot slot;
+
+	if ( (slot = slotFind(nam)) )
+		return slot;
+
+	epicsMutexMustLock( slotMtx );
+	if ( !(slot = slotFind(nam)) )
+		slot = slotCreate(nam);
+	epicsMutexUnlock( slotMtx );
+
+	return slot;
+}
+
+/* find the slot associated with a record and attach the
+ * record if that has not been done yet.
+ */
+static SavResSlot slotGet(struct aaoRecord *paao)
+{
+SavResSlot slot;
+
+	if ( (slot = slotFind(paao->name)) && slot->paao )
+		return slot;
+
+	if ( ! (slot = slotLookup(paao->name)) )
+		return 0;
+
+	epicsMutexMustLock( slotMtx );
+	if ( ! slot->paao ) {
+		if ( (slot->type = ftvlType(paao->ftvl)) >= 0 ) {
+			slot->esz    = savresTypeSize(slot->type);
+			slot->nbytes = paao->nelm * slot->esz;
+		}
+		if ( savresSnapshot && slot->nbytes ) {
+			if ( (slot->snap[0] = malloc(2*slot->nbytes)) ) {
+				slot->snap[1] = slot->snap[0] + slot->nbytes;
+			} else {
+				errlogPrintf("savres: no memory for snapshot of %s; dumping live data\n", paao->name);
+			}
+		}
+		membar();
+		slot->paao = paao;
+	}
+	epicsMutexUnlock( slotMtx );
+
+	return slot;
+}
+
+/* Copy the record's array into the snapshot buffer
+ * the writer is not using and make it the 'fresh' one.
+ * Must be called with the record locked.
+ */
+static void snapTake(SavResSlot slot)
+{
+int s, i;
+
+	/* withdraw the buffer we are about to overwrite */
+	do {
+		s = slot->snapState;
+		i = ( 1 == SNAP_BUSY(s) ) ? 2 : 1;
+	} while ( ! casInt(&slot->snapState, s, SNAP_FRESH(s) == i ? SNAP_STATE(0, SNAP_BUSY(s)) : s) );
+
+	memcpy(slot->snap[i-1], slot->paao->bptr, slot->nbytes);
+
+	do {
+		s = slot->snapState;
+	} while ( ! casInt(&slot->snapState, s, SNAP_STATE(i, SNAP_BUSY(s))) );
+}
+
+/* Writer side: claim the fresh snapshot (if any) */
+static char *snapAcquire(SavResSlot slot)
+{
+int s;
+
+	do {
+		s = slot->snapState;
+		if ( ! SNAP_FRESH(s) )
+			return 0;
+	} while ( ! casInt(&slot->snapState, s, SNAP_STATE(0, SNAP_FRESH(s))) );
+
+	return slot->snap[SNAP_FRESH(s) - 1];
+}
+
+static void snapRelease(SavResSlot slot)
+{
+int s;
+
+	do {
+		s = slot->snapState;
+	} while ( ! casInt(&slot->snapState, s, SNAP_STATE(SNAP_FRESH(s), 0)) );
+}
+
+/* Bounded multi-producer/single-consumer ring of pending
+ * slots (after D. Vyukov). Producers never block: if the
+ * ring is full the slot is pushed on a (lock-free, LIFO)
+ * overflow list instead which the writer drains once
+ * the ring is empty. Since a slot is queued at most once
+ * its 'retryNext' link can never be in use twice.
+ */
+typedef struct SavResCellRec_ {
+	volatile unsigned seq;
+	SavResSlot        slot;
+} SavResCellRec, *SavResCell;
+
+/* Files are written to temporary files first which replace
+ * the old versions only when a batch of up to SAVRES_BATCH_MAX
+ * records is committed; the file system is then synced once
+ * for all records with SAVRES_DURABLE_BATCH durability.
+ */
+#define SAVRES_BATCH_MAX 32
+
+typedef struct SavResWriterRec_ {
+	SavResCell           ring;
+	unsigned             mask;
+	volatile unsigned    head;   /* consumer */
+	volatile unsigned    tail;   /* producers */
+	SavResSlot volatile  retry;  /* overflow list */
+	epicsEventId         wakeup;
+	epicsThreadId        tid;
+	char                *path;
+	int                  dfd;    /* directory of 'path' */
+	SavResSlot           batch[SAVRES_BATCH_MAX];
+	int                  nbatch;
+	SavResSlot           deferred;
+	SavResAio            aio;
+	int                  inflight;
+} SavResWriterRec, *SavResWriter;
+
+/* Ring size; rounded up to a power of two. Since every
+ * record is queued at most once this need not exceed
+ * the number of records that are saved asynchronously.
+ */
+int savresQueueDepth = 256;
+epicsExportAddress(int, savresQueueDepth);
+
+#define SAVRES_MAX_QUEUE (1 << 20)
+
+/* number of submissions that found the ring full */
+volatile unsigned long aaoSavResOverflows = 0;
+
+/* Pool of writers; every record is always handled by the
+ * same writer (selected by hashing its name) so that the
+ * writes of a record remain ordered while independent
+ * records are written in parallel.
+ */
+static SavResWriter writers   = 0;
+static int          nWriters  = 0;
+
+static int          cfgWriters  = 1;
+static int          cfgPriority = epicsThreadPriorityLow;
+
+/* asynchronous I/O; disabled if depth is 0 */
+static int          cfgAioDepth   = 0;
+static int          cfgAioThreads = 4;
+
+#define SAVRES_MAX_WRITERS 32
+
+#define slotWriter(slot) ( &writers[ (slot)->hash % nWriters ] )
+
+/* packed archive backend; one file per record if NULL */
+static SavResArchive theArchive = 0;
+
+/* restore prefetching; disabled if no threads are configured */
+static int            cfgPfThreads = 0;
+static int            cfgPfMB      = 64;
+static int            iocInitStarted = 0;
+static SavResPrefetch prefetch     = 0;
+static unsigned long  pfHits       = 0;
+static unsigned long  pfMisses     = 0;
+
+/* deferred restores; list ordered by rstrOrder */
+static SavResSlot     rstrList     = 0;
+static int            rstrStarted  = 0;
+static int            rstrRunning  = 0;
+static unsigned long  rstrDone     = 0;
+static unsigned long  rstrFailed   = 0;
+static unsigned long  rstrSkipped  = 0;
+
+static int ringPush(SavResWriter w, SavResSlot slot)
+{
+unsigned   pos = w->tail;
+SavResCell cell;
+int        dif;
+
+	for (;;) {
+		cell = &w->ring[pos & w->mask];
+		dif  = (int)(cell->seq - pos);
+		if ( 0 == dif ) {
+			if ( casInt((volatile int*)&w->tail, (int)pos, (int)(pos + 1)) )
+				break;
+			pos = w->tail;
+		} else if ( dif < 0 ) {
+			return -1; /* full */
+		} else {
+			pos = w->tail;
+		}
+	}
+	cell->slot = slot;
+	membar();
+	cell->seq  = pos + 1;
+	return 0;
+}
+
+static SavResSlot ringPop(SavResWriter w)
+{
+unsigned   pos  = w->head;
+SavResCell cell = &w->ring[pos & w->mask];
+SavResSlot slot;
+
+	if ( (int)(cell->seq - (pos + 1)) < 0 )
+		return 0; /* empty */
+	membar();
+	slot      = cell->slot;
+	w->head   = pos + 1;
+	membar();
+	cell->seq = pos + w->mask + 1;
+	return slot;
+}
+
+/* Queue a slot without ever blocking the caller */
+static void slotSubmit(SavResWriter w, SavResSlot slot)
+{
+SavResSlot old;
+
+	if ( ringPush(w, slot) ) {
+		do {
+			old = w->retry;
+			slot->retryNext = old;
+		} while ( !casPtr((void * volatile *)&w->retry, old, slot) );
+		incUlong(&aaoSavResOverflows);
+		slot->stats.overflows++;
+	}
+	epicsEventSignal( w->wakeup );
+}
+
+/* DATA_PATH is looked up once; it must be set before
+ * the facility is used (i.e., before iocInit).
+ */
+static char *gpath()
+{
+static char      *path  = 0;
+static int        valid = 0;
+struct stat      sbuf;
+
+	if ( !valid ) {
+		path = getenv("DATA_PATH");
+		if ( !path && !stat(DEFAULT_PATH, &sbuf) && S_ISDIR(sbuf.st_mode) )
+			path = DEFAULT_PATH;
+		valid = 1;
+	}
+	return path;
+}
+
+
+/* Rate limiting. A record is not saved more often than
+ * every 'savresMinInterval' seconds (may be overridden
+ * per record); if it is, then the save is deferred.
+ * All writers share a budget of 'savresBandwidth' bytes
+ * per second (0: unlimited); a writer which exceeds it
+ * sleeps until the budget has recovered (coalescing
+ * requests in the meantime).
+ */
+double savresMinInterval = 0.;
+epicsExportAddress(double, savresMinInterval);
+
+int savresBandwidth = 0;
+epicsExportAddress(int, savresBandwidth);
+
+static epicsMutexId bwMtx    = 0;
+static double       bwTokens = 0.;
+static double       bwLast   = 0.;
+
+/* Seconds on a clock that doesn't jump when the wall clock is
+ * set; used for intervals (min. interval, bandwidth budget,
+ * latencies). The statistics' time stamps are wall-clock time.
+ */
+#if defined(EPICS_VERSION_INT) && defined(VERSION_INT)
+#if EPICS_VERSION_INT >= VERSION_INT(3,16,1,0)
+#define HAS_MONOTONIC
+#endif
+#endif
+
+#if defined(HAS_MONOTONIC)
+static double tnow()
+{
+	return 1.E-9 * (double)epicsMonotonicGet();
+}
+#elif defined(CLOCK_MONOTONIC)
+static double tnow()
+{
+struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + 1.E-9 * (double)now.tv_nsec;
+}
+#else
+static double tnow()
+{
+epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	return (double)now.secPastEpoch + 1.E-9 * (double)now.nsec;
+}
+#endif
+
+/* RETURNS: seconds until the slot may be saved again */
+static double slotDelay(SavResSlot slot, double now)
+{
+double ival = slot->minInterval < 0. ? savresMinInterval : slot->minInterval;
+
+	if ( ival <= 0. || 0. == slot->lastSave )
+		return 0.;
+	return slot->lastSave + ival - now;
+}
+
+/* Charge 'n' bytes to the global budget. At most one
+ * second's worth of unused budget is accumulated.
+ * RETURNS: seconds the caller must wait before writing.
+ */
+static double bwTake(unsigned long n)
+{
+double rate = savresBandwidth, now, dly = 0.;
+
+	if ( rate <= 0. )
+		return 0.;
+
+	epicsMutexMustLock( bwMtx );
+		now = tnow();
+		bwTokens += ( now - bwLast ) * rate;
+		bwLast    = now;
+		if ( bwTokens > rate )
+			bwTokens = rate;
+		bwTokens -= n;
+		if ( bwTokens < 0. )
+			dly = -bwTokens / rate;
+	epicsMutexUnlock( bwMtx );
+
+	return dly;
+}
+
+/* Statistics */
+#define LAT_BIN(ms) ( (ms) < 1. ? 0 : ( (ms) >= (double)(1 << (SAVRES_STAT_BINS - 2)) ? SAVRES_STAT_BINS - 1 : lat2bin(ms) ) )
+
+/* number of submissions which were lost */
+static volatile unsigned long savresDropped = 0;
+
+static int lat2bin(double ms)
+{
+int i;
+	for ( i = 1; ms >= 2.; i++ )
+		ms /= 2.;
+	return i;
+}
+
+static void statError(SavResSlot slot, int err)
+{
+	slot->stats.errors++;
+	slot->stats.lastErrno = err;
+	epicsTimeGetCurrent( &slot->stats.lastError );
+}
+
+/* a batched save became visible (st == 0) or failed */
+static void commitDone(SavResSlot slot, int st)
+{
+	if ( st ) {
+		statError(slot, errno);
+		if ( slot->dlt )
+			savresDeltaInvalidate(slot->dlt);
+	} else {
+		epicsTimeGetCurrent( &slot->stats.lastSuccess );
+	}
+}
+
+/* Bookkeeping after saving a slot succeeded (st == 0) or
+ * failed; 'bytes' were written since 't0'.
+ */
+static void dumpDone(SavResWriter w, SavResSlot slot, int st, int delta, double bytes, double t0)
+{
+double dly;
+
+	if ( delta && slot->dlt ) {
+		if ( st )
+			savresDeltaInvalidate(slot->dlt);
+		else
+			savresDeltaCommit(slot->dlt, slot->nbytes);
+	}
+
+	slot->lastSave = tnow();
+
+	if ( st ) {
+		statError(slot, errno);
+	} else {
+		slot->stats.saves++;
+		slot->stats.bytes += bytes;
+		dly = 1000. * (slot->lastSave - t0);
+		slot->stats.latSum += dly;
+		if ( dly > slot->stats.latMax )
+			slot->stats.latMax = dly;
+		slot->stats.lat[ LAT_BIN(dly) ]++;
+	}
+
+	if ( slot->snap[0] )
+		snapRelease(slot);
+
+	if ( ! st && ! slot->inBatch ) {
+		slot->inBatch = 1;
+		w->batch[w->nbatch++] = slot;
+	}
+}
+
+/* Collect an asynchronous save which finished.
+ * RETURNS: 0 if there was none (and 'wait' was not set).
+ */
+static int aioReap(SavResWriter w, int wait)
+{
+SavResAioJob j;
+SavResSlot   slot;
+
+	if ( ! (j = savresAioReap(w->aio, wait)) )
+		return 0;
+
+	slot         = j->usr;
+	slot->ioBusy = 0;
+	w->inflight--;
+
+	if ( j->status ) {
+		errlogPrintf("savresDumpData; error writing %s: %s\n", slot->name, strerror(j->err));
+		unlinkAt(slot->file.dfd, slot->file.tmp);
+		errno = j->err;
+	}
+	dumpDone(w, slot, j->status, slot->ioDelta, (double)(j->hlen + j->n), slot->ioStart);
+	return 1;
+}
+
+/* Start writing a slot's temporary file asynchronously;
+ * it is finished by aioReap.
+ * RETURNS: 0 on success, -1 if the file can't be created.
+ */
+static int aioStart(SavResWriter w, SavResSlot slot, char *data, unsigned long len, int delta, double t0)
+{
+int   fd;
+
+	if ( w->inflight >= cfgAioDepth )
+		aioReap(w, 1);
+
+	if ( (fd = createAt(slot->file.dfd, slot->file.tmp, slot->file.lvl, O_WRONLY|O_CREAT|O_TRUNC, 0777)) < 0 ) {
+		errlogPrintf("savresDumpData; unable to open file for writing: %s\n", strerror(errno));
+		return -1;
+	}
+
+	slot->job.fd     = fd;
+	slot->job.hdr    = slot->hdr;
+	slot->job.hlen   = sizeof(slot->hdr);
+	slot->job.buf    = data;
+	slot->job.n      = len;
+	slot->job.dosync = ( SAVRES_DURABLE_SYNC == slotDurability(slot) );
+	slot->job.usr    = slot;
+	slot->ioBusy     = 1;
+	slot->ioDelta    = delta;
+	slot->ioStart    = t0;
+	w->inflight++;
+	savresAioSubmit(w->aio, &slot->job);
+	return 0;
+}
+
+/* make all files written since the last commit visible */
+static void batchCommit(SavResWriter w)
+{
+int        i, nsync = 0, durable = 0;
+SavResSlot slot;
+
+	/* saves still in flight belong to this batch */
+	while ( w->inflight )
+		aioReap(w, 1);
+
+	for ( i = 0; i < w->nbatch; i++ ) {
+		switch ( slotDurability( w->batch[i] ) ) {
+			case SAVRES_DURABLE_BATCH: nsync++; /* fall thru */
+			case SAVRES_DURABLE_SYNC:  durable = 1;
+			default:                   break;
+		}
+	}
+
+	if ( theArchive ) {
+		/* data first, then the index */
+		if ( nsync )
+			savresArchiveSync(theArchive);
+		for ( i = 0; i < w->nbatch; i++ ) {
+			slot          = w->batch[i];
+			slot->inBatch = 0;
+			commitDone(slot, savresArchiveCommit(theArchive, slot->name));
+		}
+		if ( nsync )
+			savresArchiveSync(theArchive);
+		w->nbatch = 0;
+		return;
+	}
+
+	if ( nsync && savresSyncFs(w->path) ) {
+		/* no way to sync the file system at once */
+		for ( i = 0; i < w->nbatch; i++ ) {
+			if ( SAVRES_DURABLE_BATCH == slotDurability( w->batch[i] ) )
+				syncAt(w->batch[i]->file.dfd, w->batch[i]->inPlace ? w->batch[i]->file.nam : w->batch[i]->file.tmp);
+		}
+	}
+
+	for ( i = 0; i < w->nbatch; i++ ) {
+		slot          = w->batch[i];
+		slot->inBatch = 0;
+		commitDone(slot, slot->inPlace ? 0 : commitAt(slot->file.dfd, slot->file.nam, slot->file.tmp));
+		/* with hashed directories the files are spread out */
+		if ( durable && slot->file.lvl && ! slot->inPlace )
+			syncParent(slot->file.dfd, slot->file.nam);
+	}
+
+	if ( durable && ! savresShardLevels ) {
+		if ( w->dfd > -1 )
+			fsync(w->dfd);
+		else
+			savresSyncDir(w->path);
+	}
+
+	w->nbatch = 0;
+}
+
+/* Find out which blocks changed since the last save.
+ * RETURNS: number of changed blocks, -1 if unknown
+ *          (write everything).
+ */
+static int deltaCheck(SavResSlot slot, char *buf, int delta)
+{
+	if ( ! delta ) {
+		/* hashes become stale while disabled */
+		if ( slot->dlt )
+			savresDeltaInvalidate(slot->dlt);
+		return -1;
+	}
+	if ( ! slot->dlt && ! (slot->dlt = savresDeltaCreate(slot->nbytes)) ) {
+		errlogPrintf("savres: no memory for delta hashes of %s\n", slot->name);
+		return -1;
+	}
+	return savresDeltaCompare(slot->dlt, buf, slot->nbytes);
+}
+
+/* Compress the data if requested and if they shrink.
+ * RETURNS: packed data (length in *plen, codec used
+ *          in *pcodec) or 'buf'.
+ */
+static char *packSlot(SavResSlot slot, char *buf, unsigned long *plen, int *pcodec)
+{
+int           codec = slotCodec(slot);
+unsigned long l;
+
+	*plen   = slot->nbytes;
+	*pcodec = SAVRES_CODEC_NONE;
+	if ( SAVRES_CODEC_NONE == codec )
+		return buf;
+	if ( ! slot->pack && ! (slot->pack = malloc(slot->nbytes + SAVRES_PACK_WORK(slot->nbytes))) ) {
+		errlogPrintf("savres: no memory for compressing %s; disabling compression\n", slot->name);
+		slot->codec = SAVRES_CODEC_NONE;
+		return buf;
+	}
+	if ( ! (l = savresPack(slot->pack, buf, slot->nbytes, codec, slot->esz, slot->pack + slot->nbytes)) )
+		return buf;
+	*plen   = l;
+	*pcodec = codec;
+	return slot->pack;
+}
+
+static void dumpSlot(SavResWriter w, SavResSlot slot)
+{
+struct aaoRecord *paao = slot->paao;
+char             *buf, *data;
+unsigned long     len;
+int               st, nchg, delta, codec, inPlace;
+double            dly, t0;
+struct iovec      iov[2];
+
+	/* the previous save must have finished */
+	while ( slot->ioBusy )
+		aioReap(w, 1);
+
+	if ( slotDelay(slot, tnow()) > 0. ) {
+		/* too early; leave it 'queued' */
+		if ( ! slot->deferred ) {
+			slot->deferred  = 1;
+			slot->deferNext = w->deferred;
+			w->deferred     = slot;
+		}
+		return;
+	}
+
+	/* clear before dumping; if the record is processed while
+	 * we are writing then it is queued again and its newest
+	 * contents are written once more.
+	 */
+	slot->queued = 0;
+	membar();
+
+	dly = 1000. * (tnow() - slot->tSubmit);
+	slot->stats.waitSum += dly;
+	if ( dly > slot->stats.waitMax )
+		slot->stats.waitMax = dly;
+
+	/* ignore invalid ftvl */
+	if ( ! slot->nbytes )
+		return;
+
+	if ( w->nbatch + w->inflight >= SAVRES_BATCH_MAX )
+		batchCommit(w);
+
+	if ( slot->snap[0] ) {
+		if ( ! (buf = snapAcquire(slot)) )
+			return; /* nothing new */
+	} else {
+		buf = paao->bptr;
+	}
+
+	delta = slotDelta(slot);
+
+	if ( 0 == (nchg = deltaCheck(slot, buf, delta)) ) {
+		/* identical to what was saved last, i.e., the file is
+		 * up to date (once a pending batch is committed, which
+		 * then updates the time).
+		 */
+		slot->stats.skipped++;
+		if ( ! slot->inBatch )
+			epicsTimeGetCurrent( &slot->stats.lastSuccess );
+		snapRelease(slot);
+		return;
+	}
+
+	data = packSlot(slot, buf, &len, &codec);
+	savresMkHdr(slot->hdr, slot->type, paao->nelm, codec, data, len);
+
+	inPlace = ! theArchive && nchg > 0 && data == buf && ! slot->rewrite && ( ! slot->inBatch || slot->inPlace );
+
+	if ( (dly = bwTake( inPlace ? (unsigned long)nchg * SAVRES_DELTA_BLK : len + sizeof(slot->hdr) )) > 0. ) {
+		/* don't hold back what has been written so far */
+		batchCommit(w);
+		epicsThreadSleep( dly );
+	}
+
+	t0 = tnow();
+
+	if ( theArchive ) {
+		st = savresArchiveDumpHdr(theArchive, slot->name, slot->hdr, sizeof(slot->hdr), data, len, slotDurability(slot));
+	} else if ( ! slot->file.nam && handleInit(&slot->file, w->dfd, w->path, slot->name) ) {
+		errlogPrintf("savres: no memory for file names of %s\n", slot->name);
+		st = -1;
+	} else {
+		st = -1;
+		/* a pending temporary file supersedes the real one; if there is
+		 * one then it must be rewritten as a whole. Compressed data
+		 * can't be updated in place.
+		 */
+		if ( inPlace ) {
+			st = deltaWriteAt(slot->file.dfd, slot->file.nam, slot->hdr, sizeof(slot->hdr), buf, slot->nbytes, slot->dlt, SAVRES_DURABLE_SYNC == slotDurability(slot));
+			slot->inPlace = ! st;
+		}
+		if ( st ) {
+			slot->inPlace = 0;
+			slot->rewrite = 0;
+			/* large arrays bypass the page cache synchronously */
+			if ( ! w->aio || uncached(len) ) {
+				iov[0].iov_base = slot->hdr;
+				iov[0].iov_len  = sizeof(slot->hdr);
+				iov[1].iov_base = data;
+				iov[1].iov_len  = len;
+				st = dumpTmpAt(slot->file.dfd, slot->file.tmp, slot->file.lvl, iov, 2, SAVRES_DURABLE_SYNC == slotDurability(slot));
+			}
+			else if ( ! (st = aioStart(w, slot, data, len, delta, t0)) )
+				return;
+		}
+	}
+
+	dumpDone(w, slot, st, delta, inPlace ? (double)nchg * SAVRES_DELTA_BLK : (double)(len + sizeof(slot->hdr)), t0);
+
+	/* aao can't do async processing :-( */
+#if 0
+	dbScanLock( (dbCommon*)paao );
+	(*paao->rset->process)((dbCommon*)paao);
+	dbScanUnlock( (dbCommon*)paao );
+#endif
+}
+
+/* Save deferred slots which are due.
+ * RETURNS: seconds until the next one is due; < 0 if none
+ *          is left.
+ */
+static double deferRun(SavResWriter w)
+{
+SavResSlot slot, *pp;
+double     now = tnow(), dly, rval = -1.;
+
+	for ( pp = &w->deferred; (slot = *pp); ) {
+		if ( (dly = slotDelay(slot, now)) <= 0. ) {
+			*pp            = slot->deferNext;
+			slot->deferred = 0;
+			dumpSlot(w, slot);
+		} else {
+			if ( rval < 0. || dly < rval )
+				rval = dly;
+			pp = &slot->deferNext;
+		}
+	}
+	return rval;
+}
+
+static void writer(void *arg)
+{
+SavResWriter     w    = arg;
+SavResSlot       slot, next, prev;
+double           tmo;
+
+	w->path = gpath();
+	w->dfd  = dirOpen(w->path);
+
+	do {
+		tmo = deferRun(w);
+		/* deferred saves which were done */
+		batchCommit(w);
+
+		if ( tmo < 0. )
+			epicsEventMustWait( w->wakeup );
+		else
+			epicsEventWaitWithTimeout( w->wakeup, tmo );
+
+		do {
+			while ( (slot = ringPop(w)) )
+				dumpSlot(w, slot);
+
+			/* ring is drained; now handle overflows in FIFO order */
+			slot = xchgPtr((void * volatile *)&w->retry, 0);
+			for ( prev = 0; slot; slot = next ) {
+				next            = slot->retryNext;
+				slot->retryNext = prev;
+				prev            = slot;
+			}
+			for ( slot = prev; slot; slot = next ) {
+				next = slot->retryNext;
+				dumpSlot(w, slot);
+			}
+		} while ( prev );
+
+		/* nothing pending; this is the end of a cycle */
+		batchCommit(w);
+	} while (1);
+}
+
+/* schedule asynchronous dumping of record data;
+ * record is processed again (2nd phase) when
+ * writing completes.
+ * 
+ * This routine sets PACT.
+ *
+ * A record which is already pending is not queued
+ * a second time; the writer dumps the most recent
+ * snapshot when it gets to it.
+ */
+int
+aaoDumpDataAsync(struct aaoRecord *paao)
+{
+SavResSlot slot;
+
+	if ( ! (slot = slotGet(paao)) ) {
+		incUlong(&savresDropped);
+		return -1;
+	}
+
+	slot->stats.submits++;
+
+	/* the record doesn't hold its data yet; don't
+	 * let it overwrite the file.
+	 */
+	if ( slot->rstrPending ) {
+		slot->rstrRefused = 1;
+		return -1;
+	}
+
+	if ( slot->snap[0] )
+		snapTake(slot);
+
+	if ( ! casInt(&slot->queued, 0, 1) ) {
+		/* coalesced with the pending job */
+		slot->stats.coalesced++;
+		return 0;
+	}
+
+	slot->tSubmit = tnow();
+
+	slotSubmit(slotWriter(slot), slot);
+
+	/* aao doesn't allow for async processing :-(.
+	 * So we just asynchronously write the data out.
+	 */
+#if 0
+	if ( id ) {
+		paao->pact = TRUE;
+	}
+#endif
+	return 0;
+}
+
+/* Files w/o header saved by a host with 8-byte longs hold
+ * 8-byte DBF_LONG/DBF_ULONG elements; truncate these.
+ */
+#define longsWere8(paao) ( 4 != sizeof(long) && ( DBF_LONG == (paao)->ftvl || DBF_ULONG == (paao)->ftvl ) )
+
+/* copy (decoded) data from a view into the record's 'buf' */
+static int rstrView(struct aaoRecord *paao, SavResView v, char *buf, int n)
+{
+epicsInt32    *d;
+const char    *p;
+unsigned long i;
+int           got = v->n;
+
+	if ( savresViewCheck(v, ftvlType(paao->ftvl), paao->nelm, paao->name) )
+		return -1;
+
+	if ( longsWere8(paao) && got == paao->nelm * sizeof(long) ) {
+		for ( i = 0, d = (epicsInt32*)buf, p = v->data; i < paao->nelm; i++, p += sizeof(long) )
+			d[i] = ((const long*)p)[0];
+		got = n;
+	} else {
+		if ( got > n )
+			got = n;
+		savresCopy(buf, v->data, got);
+	}
+	return got;
+}
+
+static int rstrFile(char *path, struct aaoRecord *paao, char *buf, int n)
+{
+SavResViewRec v;
+int           got;
+
+	if ( ! longsWere8(paao) )
+		return rstrPath(path, paao->name, buf, n, ftvlType(paao->ftvl), paao->nelm);
+
+	if ( savresMapData(path, paao->name, &v) < 0 )
+		return -1;
+	got = rstrView(paao, &v, buf, n);
+	savresUnmapData(&v);
+	return got;
+}
+
+/* Restore the data of a record into 'buf' (its array or a
+ * private buffer); the record must be locked if 'buf' is its
+ * array, unless the database is being initialized.
+ * RETURNS: number of bytes restored or -1.
+ */
+static int rstrRecord(struct aaoRecord *paao, SavResSlot slot, char *buf, int n)
+{
+int           rval = -1;
+SavResViewRec v;
+
+	if ( theArchive )
+		rval = savresArchiveRstrTyped(theArchive, paao->name, buf, n, ftvlType(paao->ftvl), paao->nelm);
+	if ( rval < 0 && prefetch ) {
+		if ( ! savresPrefetchGet(prefetch, paao->name, &v) ) {
+			rval = rstrView(paao, &v, buf, n);
+			savresUnmapData(&v);
+			pfHits++;
+		} else {
+			pfMisses++;
+		}
+	}
+	if ( rval < 0 )
+		rval = rstrFile(gpath(), paao, buf, n);
+	/* the file now is known to hold the record's data (but
+	 * maybe in another format; it must be rewritten in full
+	 * before it can be updated in place).
+	 */
+	if ( slot && slotDelta(slot) && rval == slot->nbytes ) {
+		if ( slot->dlt || (slot->dlt = savresDeltaCreate(slot->nbytes)) ) {
+			savresDeltaSet(slot->dlt, buf, rval);
+			slot->rewrite = 1;
+		}
+	}
+	return rval;
+}
+
+/* Queue a record for the restore thread; records of equal
+ * order are restored in the order in which they were queued.
+ */
+static void rstrDefer(SavResSlot slot)
+{
+SavResSlot *pp;
+
+	for ( pp = &rstrList; *pp && (*pp)->rstrOrder <= slot->rstrOrder; pp = &(*pp)->rstrNext )
+		/* nothing else to do */;
+	slot->rstrNext    = *pp;
+	*pp               = slot;
+	slot->rstrPending = 1;
+}
+
+/* the prefetcher leaves these alone */
+static int rstrIsDeferred(const char *nam)
+{
+SavResSlot slot = slotFind(nam);
+	return slot && slot->rstrOrder >= 0;
+}
+
+/* True if the record got new data while its restore was
+ * pending; these are more recent than what is in the file.
+ */
+#define rstrObsolete(slot) ( ! (slot)->paao->udf || (slot)->rstrRefused )
+
+static void rstrDeferred(void *arg)
+{
+SavResSlot        slot;
+struct aaoRecord *paao;
+unsigned short    mask;
+char             *buf;
+int               got;
+
+	while ( (slot = rstrList) ) {
+		rstrList = slot->rstrNext;
+		paao     = slot->paao;
+
+		/* Read (and decode) w/o holding the record's lock set
+		 * which would stall its users for as long as that
+		 * takes; the record is only locked for the copy. If
+		 * there is no memory for a private buffer we read
+		 * into the record (locked).
+		 */
+		buf = 0;
+		got = -1;
+		if ( ! rstrObsolete(slot) && (buf = malloc(slot->nbytes)) )
+			got = rstrRecord(paao, slot, buf, slot->nbytes);
+
+		dbScanLock((struct dbCommon*)paao);
+		if ( rstrObsolete(slot) ) {
+			/* Do the save that was refused while we were pending */
+			errlogPrintf("savres: %s was processed before its deferred restore; not restored\n", paao->name);
+			rstrSkipped++;
+			slot->rstrPending = 0;
+			if ( slot->rstrRefused ) {
+				slot->rstrRefused = 0;
+				aaoDumpDataAsync(paao);
+			}
+		} else {
+			if ( ! buf )
+				got = rstrRecord(paao, slot, paao->bptr, slot->nbytes);
+			else if ( got > 0 )
+				savresCopy(paao->bptr, buf, got);
+			if ( got > 0 ) {
+				paao->udf = 0;
+				recGblGetTimeStamp(paao);
+				mask = recGblResetAlarms(paao);
+				/* same as aaoRecord's monitor() */
+				db_post_events(paao, &paao->val, mask | DBE_VALUE | DBE_LOG);
+				rstrDone++;
+			} else {
+				errlogPrintf("savres: deferred restore of %s failed\n", paao->name);
+				rstrFailed++;
+			}
+			slot->rstrPending = 0;
+		}
+		dbScanUnlock((struct dbCommon*)paao);
+		free(buf);
+	}
+	rstrRunning = 0;
+}
+
+int
+aaoRstrData(struct aaoRecord *paao)
+{
+int           rval, type, n;
+SavResSlot    slot;
+
+	/* try lazy init; this is usually called by single-threaded iocInit() during record init phase */
+	if ( !writers )
+		aaoSavResInit();
+
+	/* set up the slot (and snapshot buffers) now rather than
+	 * on the first dump request.
+	 */
+	slot = slotGet(paao);
+
+	if ( (type = ftvlType(paao->ftvl)) < 0 ) {
+		errlogPrintf("aaoRstrData: unsupported FTVL (%s)\n", paao->name);
+		return -1;
+	}
+	n = paao->nelm * savresTypeSize(type);
+
+	/* leave it to the restore thread (which starts once
+	 * iocInit is done); the record stays undefined until then.
+	 */
+	if ( slot && slot->rstrOrder >= 0 && slot->nbytes == n && iocInitStarted && ! rstrStarted ) {
+		paao->udf  = 1;
+		paao->stat = UDF_ALARM;
+		paao->sevr = INVALID_ALARM;
+		rstrDefer(slot);
+		return 0;
+	}
+
+	rval = rstrRecord(paao, slot, paao->bptr, n);
+	if ( rval > 0 ) {
+		paao->udf  = 0;
+		recGblResetAlarms(paao);
+	}
+	return rval;
+}
+
+int 
+aaoSavResInit()
+{
+SavResWriter w;
+unsigned     n, i;
+int          k;
+char         nam[32];
+
+	if ( writers )
+		return 0;
+
+	if ( savresQueueDepth < 1 || savresQueueDepth > SAVRES_MAX_QUEUE ) {
+		errlogPrintf("aaoSavResInit: savresQueueDepth (%i) must be 1..%i; clamped\n", savresQueueDepth, SAVRES_MAX_QUEUE);
+		savresQueueDepth = savresQueueDepth < 1 ? 1 : SAVRES_MAX_QUEUE;
+	}
+
+	for ( n = 1; n < (unsigned)savresQueueDepth; n <<= 1 )
+		/* nothing else to do */;
+
+	slotInit();
+	if ( !bwMtx )
+		bwMtx = epicsMutexMustCreate();
+
+	if ( ! (w = calloc(cfgWriters, sizeof(*w))) ) {
+		errlogPrintf("aaoSavResInit: no memory for writers\n");
+		return -1;
+	}
+
+	for ( k = 0; k < cfgWriters; k++ ) {
+		if ( ! (w[k].ring = calloc(n, sizeof(*w[k].ring))) ) {
+			errlogPrintf("aaoSavResInit: no memory for queue\n");
+			return -1;
+		}
+		for ( i = 0; i < n; i++ )
+			w[k].ring[i].seq = i;
+		w[k].mask   = n - 1;
+		w[k].wakeup = epicsEventMustCreate( epicsEventEmpty );
+	}
+
+	writers  = w;
+	nWriters = cfgWriters;
+
+	for ( k = 0; k < nWriters; k++ ) {
+		if ( 1 == nWriters )
+			strcpy(nam, "aaoDataDumper");
+		else
+			sprintf(nam, "aaoDataDumper%i", k);
+		/* the archive does its own I/O */
+		if ( cfgAioDepth > 0 && ! theArchive ) {
+			if ( ! (w[k].aio = savresAioCreate(nam, cfgAioDepth, cfgAioThreads, cfgPriority)) )
+				errlogPrintf("aaoSavResInit: unable to set up asynchronous I/O; using synchronous I/O\n");
+		}
+		if ( ! (w[k].tid = epicsThreadCreate(nam, cfgPriority, epicsThreadGetStackSize(epicsThreadStackMedium), writer, &w[k])) ) {
+			errlogPrintf("aaoSavResInit: unable to create writer thread\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Configure the writer pool; the number of writers can
+ * only be set before the facility is initialized but
+ * the priority may be changed at any time.
+ */
+int
+savresWriterConfig(int nThreads, int priority)
+{
+int k;
+
+	if ( priority < epicsThreadPriorityMin || priority > epicsThreadPriorityMax ) {
+		errlogPrintf("savresWriterConfig: invalid priority %i\n", priority);
+		return -1;
+	}
+
+	if ( nThreads > 0 ) {
+		if ( nThreads > SAVRES_MAX_WRITERS ) {
+			errlogPrintf("savresWriterConfig: too many threads (max %i)\n", SAVRES_MAX_WRITERS);
+			return -1;
+		}
+		if ( writers && nThreads != nWriters ) {
+			errlogPrintf("savresWriterConfig: too late to change the number of writers (must be called before iocInit)\n");
+			return -1;
+		}
+		cfgWriters = nThreads;
+	}
+
+	if ( priority > 0 ) {
+		cfgPriority = priority;
+		for ( k = 0; k < nWriters; k++ )
+			epicsThreadSetPriority(writers[k].tid, priority);
+	}
+
+	return 0;
+}
+
+int
+savresAioConfig(int depth, int nThreads)
+{
+	if ( writers ) {
+		errlogPrintf("savresAioConfig: must be called before iocInit\n");
+		return -1;
+	}
+	if ( depth < 0 || depth > SAVRES_BATCH_MAX ) {
+		errlogPrintf("savresAioConfig: invalid depth (0..%i)\n", SAVRES_BATCH_MAX);
+		return -1;
+	}
+	cfgAioDepth = depth;
+	if ( nThreads )
+		cfgAioThreads = nThreads;
+	return 0;
+}
+
+/* Prefetching runs while the records are initialized,
+ * deferred restores once that is done.
+ */
+static void
+savresInitHook(initHookState state)
+{
+	switch ( state ) {
+		case initHookAtBeginning:
+			iocInitStarted = 1;
+			/* the archive is read at once anyway */
+			if ( cfgPfThreads > 0 && ! theArchive )
+				prefetch = savresPrefetchStart(gpath(), cfgPfThreads, (unsigned long)cfgPfMB << 20, epicsThreadPriorityMedium, rstrIsDeferred);
+		break;
+
+		case initHookAfterInitDatabase:
+			savresPrefetchStop(prefetch);
+			prefetch = 0;
+		break;
+
+		case initHookAtEnd:
+			rstrStarted = 1;
+			if ( rstrList ) {
+				rstrRunning = 1;
+				if ( ! epicsThreadCreate("savresRestore", cfgPriority, epicsThreadGetStackSize(epicsThreadStackMedium), rstrDeferred, 0) ) {
+					errlogPrintf("savres: unable to create restore thread; restoring now\n");
+					rstrDeferred(0);
+				}
+			}
+		break;
+
+		default:
+		break;
+	}
+}
+
+int
+savresPrefetchConfig(int nThreads, int cacheMB)
+{
+	if ( iocInitStarted ) {
+		errlogPrintf("savresPrefetchConfig: must be called before iocInit\n");
+		return -1;
+	}
+	if ( nThreads < 0 || cacheMB < 0 || cacheMB > 4095 ) {
+		errlogPrintf("savresPrefetchConfig: invalid argument\n");
+		return -1;
+	}
+	cfgPfThreads = nThreads;
+	if ( cacheMB )
+		cfgPfMB = cacheMB;
+	return 0;
+}
+
+int
+savresArchiveConfig(char *fnam, int maxEntries, int sizeMB)
+{
+	if ( writers ) {
+		errlogPrintf("savresArchiveConfig: must be called before iocInit\n");
+		return -1;
+	}
+	if ( theArchive ) {
+		errlogPrintf("savresArchiveConfig: archive already configured\n");
+		return -1;
+	}
+	if ( !fnam || !*fnam ) {
+		errlogPrintf("savresArchiveConfig: need a file name\n");
+		return -1;
+	}
+	return (theArchive = savresArchiveOpen(gpath(), fnam, maxEntries, sizeMB)) ? 0 : -1;
+}
+
+/* Set the durability level of a record's saves; the
+ * global default is changed if no record name is given.
+ */
+int
+savresSetDurability(const char *recName, int level)
+{
+SavResSlot slot;
+
+	if ( level < SAVRES_DURABLE_NONE || level > SAVRES_DURABLE_SYNC ) {
+		errlogPrintf("savresSetDurability: invalid level %i\n", level);
+		return -1;
+	}
+	if ( !recName || !*recName ) {
+		savresDurability = level;
+		return 0;
+	}
+	slotInit();
+	if ( ! (slot = slotLookup(recName)) )
+		return -1;
+	slot->durability = level;
+	return 0;
+}
+
+/* Enable/disable incremental saves for a record;
+ * the global default is changed if no record name
+ * is given.
+ */
+int
+savresSetDelta(const char *recName, int on)
+{
+SavResSlot slot;
+
+	if ( !recName || !*recName ) {
+		savresDelta = on;
+		return 0;
+	}
+	slotInit();
+	if ( ! (slot = slotLookup(recName)) )
+		return -1;
+	slot->delta = !!on;
+	return 0;
+}
+
+/* Select the compression of a record's saves; the
+ * global default is changed if no record name is given.
+ */
+int
+savresSetCodec(const char *recName, int codec)
+{
+SavResSlot slot;
+
+	if ( codec < SAVRES_CODEC_NONE || codec > SAVRES_CODEC_SDLZ ) {
+		errlogPrintf("savresSetCodec: invalid codec %i\n", codec);
+		return -1;
+	}
+	if ( !recName || !*recName ) {
+		savresCodec = codec;
+		return 0;
+	}
+	slotInit();
+	if ( ! (slot = slotLookup(recName)) )
+		return -1;
+	slot->codec = codec;
+	return 0;
+}
+
+/* Defer the restore of a record until iocInit is done;
+ * records of lower 'order' come first. A negative 'order'
+ * restores the record during iocInit again.
+ */
+int
+savresSetDeferredRestore(const char *recName, int order)
+{
+SavResSlot slot;
+
+	if ( !recName || !*recName ) {
+		errlogPrintf("savresSetDeferredRestore: need a record name\n");
+		return -1;
+	}
+	if ( iocInitStarted ) {
+		errlogPrintf("savresSetDeferredRestore: must be called before iocInit\n");
+		return -1;
+	}
+	slotInit();
+	if ( ! (slot = slotLookup(recName)) )
+		return -1;
+	slot->rstrOrder = order < 0 ? -1 : order;
+	return 0;
+}
+
+/* Set the minimum interval between saves of a record;
+ * the global default is changed if no record name is
+ * given.
+ */
+int
+savresSetMinInterval(const char *recName, double seconds)
+{
+SavResSlot slot;
+
+	if ( seconds < 0. ) {
+		errlogPrintf("savresSetMinInterval: invalid interval %g\n", seconds);
+		return -1;
+	}
+	if ( !recName || !*recName ) {
+		savresMinInterval = seconds;
+		return 0;
+	}
+	slotInit();
+	if ( ! (slot = slotLookup(recName)) )
+		return -1;
+	slot->minInterval = seconds;
+	return 0;
+}
+
+int
+savresSetBandwidth(int bytesPerSec)
+{
+	if ( bytesPerSec < 0 ) {
+		errlogPrintf("savresSetBandwidth: invalid bandwidth %i\n", bytesPerSec);
+		return -1;
+	}
+	savresBandwidth = bytesPerSec;
+	return 0;
+}
+
+static int tsNewer(epicsTimeStamp *a, epicsTimeStamp *b)
+{
+	return a->secPastEpoch > b->secPastEpoch || ( a->secPastEpoch == b->secPastEpoch && a->nsec > b->nsec );
+}
+
+static void statsAdd(SavResStats s, SavResStats a)
+{
+int i;
+
+	s->submits   += a->submits;
+	s->coalesced += a->coalesced;
+	s->overflows += a->overflows;
+	s->saves     += a->saves;
+	s->skipped   += a->skipped;
+	s->errors    += a->errors;
+	s->bytes     += a->bytes;
+	s->waitSum   += a->waitSum;
+	s->latSum    += a->latSum;
+	if ( a->waitMax > s->waitMax )
+		s->waitMax = a->waitMax;
+	if ( a->latMax > s->latMax )
+		s->latMax = a->latMax;
+	for ( i = 0; i < SAVRES_STAT_BINS; i++ )
+		s->lat[i] += a->lat[i];
+	if ( tsNewer(&a->lastError, &s->lastError) ) {
+		s->lastError = a->lastError;
+		s->lastErrno = a->lastErrno;
+	}
+	if ( tsNewer(&a->lastSuccess, &s->lastSuccess) )
+		s->lastSuccess = a->lastSuccess;
+}
+
+int
+savresGetStats(const char *recName, SavResStats s)
+{
+SavResSlot slot;
+int        i;
+
+	memset(s, 0, sizeof(*s));
+
+	if ( recName && *recName ) {
+		if ( ! (slot = slotFind(recName)) || ! slot->paao )
+			return -1;
+		*s = slot->stats;
+		return 0;
+	}
+
+	for ( i = 0; i < SLOT_HASH_SIZE; i++ ) {
+		for ( slot = slotTbl[i]; slot; slot = slot->next )
+			statsAdd(s, &slot->stats);
+	}
+	s->dropped = savresDropped;
+	return 0;
+}
+
+static void statsPrint(SavResStats s, const char *ind, int level)
+{
+char          buf[40];
+unsigned long n;
+int           i;
+
+	n = s->submits - s->coalesced;
+	printf("%ssubmits %lu, coalesced %lu, overflows %lu, dropped %lu\n", ind,
+		s->submits, s->coalesced, s->overflows, s->dropped);
+	printf("%ssaves %lu, skipped %lu, errors %lu, bytes %.0f\n", ind,
+		s->saves, s->skipped, s->errors, s->bytes);
+	printf("%squeue wait avg/max %.3f/%.3f ms, write latency avg/max %.3f/%.3f ms\n", ind,
+		n ? s->waitSum / n : 0., s->waitMax,
+		s->saves ? s->latSum / s->saves : 0., s->latMax);
+	if ( s->lastSuccess.secPastEpoch ) {
+		epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S.%03f", &s->lastSuccess);
+		printf("%slast success: %s\n", ind, buf);
+	} else {
+		printf("%slast success: never\n", ind);
+	}
+	if ( s->errors ) {
+		epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S.%03f", &s->lastError);
+		printf("%slast error:   %s (%s)\n", ind, buf, strerror(s->lastErrno));
+	}
+	if ( level > 1 ) {
+		printf("%swrite latency histogram:\n", ind);
+		for ( i = 0; i < SAVRES_STAT_BINS; i++ ) {
+			if ( ! s->lat[i] )
+				continue;
+			if ( 0 == i )
+				printf("%s        < %6u ms: %lu\n", ind, 1, s->lat[i]);
+			else if ( SAVRES_STAT_BINS - 1 == i )
+				printf("%s       >= %6u ms: %lu\n", ind, 1 << (i - 1), s->lat[i]);
+			else
+				printf("%s %6u - %6u ms: %lu\n", ind, 1 << (i - 1), 1 << i, s->lat[i]);
+		}
+	}
+}
+
+/* Print statistics: 0 - totals only, 1 - per record, too,
+ * 2 - with latency histograms.
+ */
+void
+savresReport(int level)
+{
+SavResStatsRec s;
+SavResSlot     slot;
+int            i, nrec = 0;
+
+	for ( i = 0; i < SLOT_HASH_SIZE; i++ ) {
+		for ( slot = slotTbl[i]; slot; slot = slot->next )
+			if ( slot->paao )
+				nrec++;
+	}
+
+	printf("savres: %i writer(s), %i record(s), %s\n", nWriters, nrec, theArchive ? "archive" : "one file per record");
+	printf("  durability %i, min. interval %g s, bandwidth %i B/s\n", savresDurability, savresMinInterval, savresBandwidth);
+	if ( nWriters && writers[0].aio )
+		printf("  asynchronous I/O: %s, depth %i\n", savresAioBackend(writers[0].aio), cfgAioDepth);
+	if ( rstrStarted && (rstrRunning || rstrDone || rstrFailed || rstrSkipped) )
+		printf("  deferred restore: %lu done, %lu failed, %lu skipped%s\n", rstrDone, rstrFailed, rstrSkipped, rstrRunning ? ", in progress" : "");
+	if ( cfgPfThreads > 0 )
+		printf("  restore prefetch: %i thread(s), %i MB; %lu restored from cache, %lu not\n", cfgPfThreads, cfgPfMB, pfHits, pfMisses);
+
+	savresGetStats(0, &s);
+	statsPrint(&s, "  ", level > 1 ? level : 0);
+
+	if ( level < 1 )
+		return;
+
+	for ( i = 0; i < SLOT_HASH_SIZE; i++ ) {
+		for ( slot = slotTbl[i]; slot; slot = slot->next ) {
+			if ( ! slot->paao )
+				continue;
+			printf("  %s (%lu bytes):\n", slot->name, slot->nbytes);
+			statsPrint(&slot->stats, "    ", level);
+		}
+	}
+}
+
+static const iocshArg savresSetDurabilityArg0 = {"recordName", iocshArgString};
+static const iocshArg savresSetDurabilityArg1 = {"level"     , iocshArgInt};
+static const iocshArg * const savresSetDurabilityArgs[2] = {
+	&savresSetDurabilityArg0, &savresSetDurabilityArg1};
+static const iocshFuncDef savresSetDurabilityFuncDef =
+	{"savresSetDurability", 2, savresSetDurabilityArgs};
+static void savresSetDurabilityCallFunc(const iocshArgBuf *args)
+{
+	savresSetDurability(args[0].sval, args[1].ival);
+}
+
+static const iocshArg savresSetDeltaArg0 = {"recordName", iocshArgString};
+static const iocshArg savresSetDeltaArg1 = {"on"        , iocshArgInt};
+static const iocshArg * const savresSetDeltaArgs[2] = {
+	&savresSetDeltaArg0, &savresSetDeltaArg1};
+static const iocshFuncDef savresSetDeltaFuncDef =
+	{"savresSetDelta", 2, savresSetDeltaArgs};
+static void savresSetDeltaCallFunc(const iocshArgBuf *args)
+{
+	savresSetDelta(args[0].sval, args[1].ival);
+}
+
+static const iocshArg savresSetCodecArg0 = {"recordName", iocshArgString};
+static const iocshArg savresSetCodecArg1 = {"codec"     , iocshArgInt};
+static const iocshArg * const savresSetCodecArgs[2] = {
+	&savresSetCodecArg0, &savresSetCodecArg1};
+static const iocshFuncDef savresSetCodecFuncDef =
+	{"savresSetCodec", 2, savresSetCodecArgs};
+static void savresSetCodecCallFunc(const iocshArgBuf *args)
+{
+	savresSetCodec(args[0].sval, args[1].ival);
+}
+
+static const iocshArg savresSetMinIntervalArg0 = {"recordName", iocshArgString};
+static const iocshArg savresSetMinIntervalArg1 = {"seconds"   , iocshArgDouble};
+static const iocshArg * const savresSetMinIntervalArgs[2] = {
+	&savresSetMinIntervalArg0, &savresSetMinIntervalArg1};
+static const iocshFuncDef savresSetMinIntervalFuncDef =
+	{"savresSetMinInterval", 2, savresSetMinIntervalArgs};
+static void savresSetMinIntervalCallFunc(const iocshArgBuf *args)
+{
+	savresSetMinInterval(args[0].sval, args[1].dval);
+}
+
+static const iocshArg savresSetBandwidthArg0 = {"bytesPerSec", iocshArgInt};
+static const iocshArg * const savresSetBandwidthArgs[1] = {
+	&savresSetBandwidthArg0};
+static const iocshFuncDef savresSetBandwidthFuncDef =
+	{"savresSetBandwidth", 1, savresSetBandwidthArgs};
+static void savresSetBandwidthCallFunc(const iocshArgBuf *args)
+{
+	savresSetBandwidth(args[0].ival);
+}
+
+static const iocshArg savresWriterConfigArg0 = {"nThreads", iocshArgInt};
+static const iocshArg savresWriterConfigArg1 = {"priority", iocshArgInt};
+static const iocshArg * const savresWriterConfigArgs[2] = {
+	&savresWriterConfigArg0, &savresWriterConfigArg1};
+static const iocshFuncDef savresWriterConfigFuncDef =
+	{"savresWriterConfig", 2, savresWriterConfigArgs};
+static void savresWriterConfigCallFunc(const iocshArgBuf *args)
+{
+	savresWriterConfig(args[0].ival, args[1].ival);
+}
+
+static const iocshArg savresAioConfigArg0 = {"depth"   , iocshArgInt};
+static const iocshArg savresAioConfigArg1 = {"nThreads", iocshArgInt};
+static const iocshArg * const savresAioConfigArgs[2] = {
+	&savresAioConfigArg0, &savresAioConfigArg1};
+static const iocshFuncDef savresAioConfigFuncDef =
+	{"savresAioConfig", 2, savresAioConfigArgs};
+static void savresAioConfigCallFunc(const iocshArgBuf *args)
+{
+	savresAioConfig(args[0].ival, args[1].ival);
+}
+
+static const iocshArg savresPrefetchConfigArg0 = {"nThreads", iocshArgInt};
+static const iocshArg savresPrefetchConfigArg1 = {"cacheMB" , iocshArgInt};
+static const iocshArg * const savresPrefetchConfigArgs[2] = {
+	&savresPrefetchConfigArg0, &savresPrefetchConfigArg1};
+static const iocshFuncDef savresPrefetchConfigFuncDef =
+	{"savresPrefetchConfig", 2, savresPrefetchConfigArgs};
+static void savresPrefetchConfigCallFunc(const iocshArgBuf *args)
+{
+	savresPrefetchConfig(args[0].ival, args[1].ival);
+}
+
+static const iocshArg savresArchiveConfigArg0 = {"fileName"  , iocshArgString};
+static const iocshArg savresArchiveConfigArg1 = {"maxRecords", iocshArgInt};
+static const iocshArg savresArchiveConfigArg2 = {"sizeMB"    , iocshArgInt};
+static const iocshArg * const savresArchiveConfigArgs[3] = {
+	&savresArchiveConfigArg0, &savresArchiveConfigArg1, &savresArchiveConfigArg2};
+static const iocshFuncDef savresArchiveConfigFuncDef =
+	{"savresArchiveConfig", 3, savresArchiveConfigArgs};
+static void savresArchiveConfigCallFunc(const iocshArgBuf *args)
+{
+	savresArchiveConfig(args[0].sval, args[1].ival, args[2].ival);
+}
+
+static const iocshArg savresSetDeferredRestoreArg0 = {"recordName", iocshArgString};
+static const iocshArg savresSetDeferredRestoreArg1 = {"order"     , iocshArgInt};
+static const iocshArg * const savresSetDeferredRestoreArgs[2] = {
+	&savresSetDeferredRestoreArg0, &savresSetDeferredRestoreArg1};
+static const iocshFuncDef savresSetDeferredRestoreFuncDef =
+	{"savresSetDeferredRestore", 2, savresSetDeferredRestoreArgs};
+static void savresSetDeferredRestoreCallFunc(const iocshArgBuf *args)
+{
+	savresSetDeferredRestore(args[0].sval, args[1].ival);
+}
+
+static const iocshArg savresReportArg0 = {"level", iocshArgInt};
+static const iocshArg * const savresReportArgs[1] = {
+	&savresReportArg0};
+static const iocshFuncDef savresReportFuncDef =
+	{"savresReport", 1, savresReportArgs};
+static void savresReportCallFunc(const iocshArgBuf *args)
+{
+	savresReport(args[0].ival);
+}
+
+static void savresRegistrar(void)
+{
+	iocshRegister(&savresSetDurabilityFuncDef, savresSetDurabilityCallFunc);
+	iocshRegister(&savresSetDeltaFuncDef,      savresSetDeltaCallFunc);
+	iocshRegister(&savresSetCodecFuncDef,      savresSetCodecCallFunc);
+	iocshRegister(&savresSetMinIntervalFuncDef, savresSetMinIntervalCallFunc);
+	iocshRegister(&savresSetBandwidthFuncDef,  savresSetBandwidthCallFunc);
+	iocshRegister(&savresSetDeferredRestoreFuncDef, savresSetDeferredRestoreCallFunc);
+	iocshRegister(&savresReportFuncDef,        savresReportCallFunc);
+	iocshRegister(&savresWriterConfigFuncDef,  savresWriterConfigCallFunc);
+	iocshRegister(&savresAioConfigFuncDef,     savresAioConfigCallFunc);
+	iocshRegister(&savresPrefetchConfigFuncDef, savresPrefetchConfigCallFunc);
+	iocshRegister(&savresArchiveConfigFuncDef, savresArchiveConfigCallFunc);
+	initHookRegister(savresInitHook);
 }
+epicsExportRegistrar(savresRegistrar);
 #endif
@@ -0,0 +1,454 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* syscall() */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <errlog.h>
+
+#include "savresUtil.h"
+#include "savresPvt.h"
+
+/* Asynchronous I/O engine for the savres writers.
+ *
+ * A writer starts jobs (write a file, flush and close it) for
+ * all records of a batch and then collects the completions,
+ * i.e., the files are written concurrently rather than one
+ * after another. Two backends exist:
+ *
+ *  - io_uring (Linux >= 5.6): the writer queues the operations
+ *    and submits all of them with a single system call; every
+ *    completion queues the next step of its job (write the
+ *    rest, fsync, close).
+ *  - a pool of threads which run the jobs synchronously
+ *    (anywhere else, or if io_uring is unavailable at run-time,
+ *    e.g., disabled by the administrator).
+ *
+ * Only the writer owning an engine submits and reaps; the
+ * engine itself needs no locking other than for the thread
+ * pool's queues.
+ */
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+/* IORING_OP_CLOSE and probing appeared along with this */
+#ifdef IORING_FEAT_CUR_PERSONALITY
+#define HAS_IO_URING
+#endif
+#endif
+
+#define STEP_WRITE 0
+#define STEP_SYNC  1
+#define STEP_CLOSE 2
+
+#ifdef HAS_IO_URING
+typedef struct URingRec_ {
+	int                  fd;
+	unsigned            *sqHead, *sqTail, *sqArray, sqMask, sqEntries;
+	unsigned            *cqHead, *cqTail, cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned             pending;   /* queued but not submitted */
+} URingRec;
+#endif
+
+typedef struct SavResAioRec_ {
+	int            uring;
+#ifdef HAS_IO_URING
+	URingRec       ur;
+#endif
+	/* finished jobs */
+	SavResAioJob   done, doneTail;
+	/* thread pool */
+	epicsMutexId   mtx;
+	epicsEventId   work, doneEv;
+	SavResAioJob   q, qTail;
+} SavResAioRec;
+
+static void fail(SavResAioJob j, int err)
+{
+	if ( ! j->status ) {
+		j->status = -1;
+		j->err    = err;
+	}
+}
+
+static void enq(SavResAioJob *ph, SavResAioJob *pt, SavResAioJob j)
+{
+	j->next = 0;
+	if ( *pt )
+		(*pt)->next = j;
+	else
+		*ph = j;
+	*pt = j;
+}
+
+static SavResAioJob deq(SavResAioJob *ph, SavResAioJob *pt)
+{
+SavResAioJob j;
+	if ( (j = *ph) && ! (*ph = j->next) )
+		*pt = 0;
+	return j;
+}
+
+/* Next piece to write: the rest of the header or of the data.
+ * RETURNS: its length (0 if everything was written).
+ */
+static unsigned long jobChunk(SavResAioJob j, const char **pp)
+{
+	if ( j->off < j->hlen ) {
+		*pp = j->hdr + j->off;
+		return j->hlen - j->off;
+	}
+	*pp = j->buf + (j->off - j->hlen);
+	return j->n - (j->off - j->hlen);
+}
+
+/* Thread pool */
+
+static void jobRun(SavResAioJob j)
+{
+const char    *p;
+unsigned long  l;
+int            put;
+
+	while ( (l = jobChunk(j, &p)) > 0 ) {
+		if ( (put = write(j->fd, p, l)) <= 0 ) {
+			if ( put < 0 && EINTR == errno )
+				continue;
+			fail(j, put ? errno : EIO);
+			break;
+		}
+		j->off += put;
+	}
+	if ( ! j->status && j->dosync && fsync(j->fd) )
+		fail(j, errno);
+	if ( close(j->fd) )
+		fail(j, errno);
+}
+
+static void worker(void *arg)
+{
+SavResAio    a = arg;
+SavResAioJob j;
+int          more;
+
+	do {
+		epicsMutexMustLock(a->mtx);
+		while ( ! (j = deq(&a->q, &a->qTail)) ) {
+			epicsMutexUnlock(a->mtx);
+			epicsEventMustWait(a->work);
+			epicsMutexMustLock(a->mtx);
+		}
+		more = ( 0 != a->q );
+		epicsMutexUnlock(a->mtx);
+
+		/* the event is binary; pass it on if there is more to do */
+		if ( more )
+			epicsEventSignal(a->work);
+
+		jobRun(j);
+
+		epicsMutexMustLock(a->mtx);
+		enq(&a->done, &a->doneTail, j);
+		epicsMutexUnlock(a->mtx);
+		epicsEventSignal(a->doneEv);
+	} while (1);
+}
+
+static int poolCreate(SavResAio a, const char *name, int nThreads, int priority)
+{
+char nam[48];
+int  i;
+
+	a->mtx    = epicsMutexMustCreate();
+	a->work   = epicsEventMustCreate(epicsEventEmpty);
+	a->doneEv = epicsEventMustCreate(epicsEventEmpty);
+
+	for ( i = 0; i < nThreads; i++ ) {
+		sprintf(nam, "%.30sIO%i", name, i);
+		if ( ! epicsThreadCreate(nam, priority, epicsThreadGetStackSize(epicsThreadStackSmall), worker, a) ) {
+			errlogPrintf("savresAioCreate: unable to create I/O thread\n");
+			/* those we have keep working */
+			return i > 0 ? 0 : -1;
+		}
+	}
+	return 0;
+}
+
+static SavResAioJob poolReap(SavResAio a, int wait)
+{
+SavResAioJob j;
+
+	do {
+		epicsMutexMustLock(a->mtx);
+		j = deq(&a->done, &a->doneTail);
+		epicsMutexUnlock(a->mtx);
+		if ( j || ! wait )
+			break;
+		epicsEventMustWait(a->doneEv);
+	} while (1);
+	return j;
+}
+
+/* io_uring; w/o liburing which is not available everywhere */
+
+#ifdef HAS_IO_URING
+#define ldAcq(p)    __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define stRel(p,v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int uringSupports(int fd)
+{
+struct io_uring_probe *p;
+size_t                 sz = sizeof(*p) + 256 * sizeof(p->ops[0]);
+int                    rval = 0;
+
+	if ( ! (p = calloc(1, sz)) )
+		return 0;
+	if ( 0 == syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, p, 256) ) {
+		rval =    p->last_op >= IORING_OP_CLOSE
+		       && (p->ops[IORING_OP_WRITE].flags  & IO_URING_OP_SUPPORTED)
+		       && (p->ops[IORING_OP_FSYNC].flags  & IO_URING_OP_SUPPORTED)
+		       && (p->ops[IORING_OP_CLOSE].flags  & IO_URING_OP_SUPPORTED);
+	}
+	free(p);
+	return rval;
+}
+
+static int uringCreate(URingRec *ur, int depth)
+{
+struct io_uring_params p;
+size_t                 sqSz, cqSz;
+char                  *sq, *cq;
+void                  *sqes;
+
+	memset(&p, 0, sizeof(p));
+	if ( (ur->fd = syscall(__NR_io_uring_setup, depth, &p)) < 0 )
+		return -1;
+
+	if ( ! uringSupports(ur->fd) )
+		goto bail;
+
+	sqSz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqSz = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ( (p.features & IORING_FEAT_SINGLE_MMAP) && cqSz > sqSz )
+		sqSz = cqSz;
+
+	sq = mmap(0, sqSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	if ( MAP_FAILED == sq )
+		goto bail;
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		cq = sq;
+	} else {
+		cq = mmap(0, cqSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+		if ( MAP_FAILED == cq )
+			goto bail;
+	}
+	sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if ( MAP_FAILED == sqes )
+		goto bail;
+
+	/* the engine lives as long as the writer, i.e., forever;
+	 * mappings are not released.
+	 */
+	ur->sqHead    = (unsigned*)(sq + p.sq_off.head);
+	ur->sqTail    = (unsigned*)(sq + p.sq_off.tail);
+	ur->sqMask    = *(unsigned*)(sq + p.sq_off.ring_mask);
+	ur->sqEntries = p.sq_entries;
+	ur->sqArray   = (unsigned*)(sq + p.sq_off.array);
+	ur->sqes      = sqes;
+	ur->cqHead    = (unsigned*)(cq + p.cq_off.head);
+	ur->cqTail    = (unsigned*)(cq + p.cq_off.tail);
+	ur->cqMask    = *(unsigned*)(cq + p.cq_off.ring_mask);
+	ur->cqes      = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	ur->pending   = 0;
+	return 0;
+
+bail:
+	close(ur->fd);
+	return -1;
+}
+
+/* Queue the next operation of a job; every job has (at most)
+ * one, hence the ring (>= depth entries) cannot overflow.
+ */
+static void uringQueue(URingRec *ur, SavResAioJob j)
+{
+unsigned             tail = *ur->sqTail;
+struct io_uring_sqe *sqe  = &ur->sqes[ tail & ur->sqMask ];
+const char          *p;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd        = j->fd;
+	sqe->user_data = (unsigned long)j;
+	switch ( j->step ) {
+		case STEP_WRITE:
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->len    = jobChunk(j, &p);
+			sqe->addr   = (unsigned long)p;
+			sqe->off    = j->off;
+		break;
+		case STEP_SYNC:
+			sqe->opcode = IORING_OP_FSYNC;
+		break;
+		default:
+			sqe->opcode = IORING_OP_CLOSE;
+		break;
+	}
+	ur->sqArray[ tail & ur->sqMask ] = tail & ur->sqMask;
+	stRel(ur->sqTail, tail + 1);
+	ur->pending++;
+}
+
+/* A job's operation completed with 'res'; queue the next one */
+static int uringStep(URingRec *ur, SavResAioJob j, int res)
+{
+	switch ( j->step ) {
+		case STEP_WRITE:
+			if ( -EINTR == res || -EAGAIN == res ) {
+				uringQueue(ur, j);
+				return 0;
+			}
+			if ( res <= 0 ) {
+				fail(j, res ? -res : EIO);
+			} else if ( (j->off += res) < j->hlen + j->n ) {
+				/* short write or the header is done */
+				uringQueue(ur, j);
+				return 0;
+			}
+			j->step = j->dosync && ! j->status ? STEP_SYNC : STEP_CLOSE;
+		break;
+		case STEP_SYNC:
+			if ( res < 0 )
+				fail(j, -res);
+			j->step = STEP_CLOSE;
+		break;
+		default:
+			if ( res < 0 )
+				fail(j, -res);
+			/* finished */
+			return 1;
+	}
+	uringQueue(ur, j);
+	return 0;
+}
+
+static void uringComplete(SavResAio a)
+{
+URingRec            *ur   = &a->ur;
+unsigned             head = *ur->cqHead;
+unsigned             tail = ldAcq(ur->cqTail);
+struct io_uring_cqe *cqe;
+SavResAioJob         j;
+
+	while ( head != tail ) {
+		cqe = &ur->cqes[ head & ur->cqMask ];
+		j   = (SavResAioJob)(unsigned long)cqe->user_data;
+		if ( uringStep(ur, j, cqe->res) )
+			enq(&a->done, &a->doneTail, j);
+		head++;
+	}
+	stRel(ur->cqHead, head);
+}
+
+static void uringEnter(URingRec *ur, int wait)
+{
+int n;
+
+	n = syscall(__NR_io_uring_enter, ur->fd, ur->pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+	if ( n >= 0 ) {
+		ur->pending -= n;
+	} else if ( EINTR != errno && EAGAIN != errno && EBUSY != errno ) {
+		errlogPrintf("savresAio: io_uring_enter failed: %s\n", strerror(errno));
+		/* don't spin */
+		epicsThreadSleep(0.1);
+	}
+}
+
+static SavResAioJob uringReap(SavResAio a, int wait)
+{
+	uringComplete(a);
+	while ( ! a->done && ( wait || a->ur.pending ) ) {
+		uringEnter(&a->ur, wait);
+		uringComplete(a);
+		if ( ! wait )
+			break;
+	}
+	/* completions may have queued follow-up operations */
+	if ( a->ur.pending )
+		uringEnter(&a->ur, 0);
+	return deq(&a->done, &a->doneTail);
+}
+#endif
+
+SavResAio
+savresAioCreate(const char *name, int depth, int nThreads, int priority)
+{
+SavResAio a;
+
+	if ( ! (a = calloc(1, sizeof(*a))) ) {
+		errlogPrintf("savresAioCreate: no memory\n");
+		return 0;
+	}
+#ifdef HAS_IO_URING
+	if ( nThreads >= 0 && 0 == uringCreate(&a->ur, depth) ) {
+		a->uring = 1;
+		return a;
+	}
+#endif
+	if ( nThreads < 0 )
+		nThreads = -nThreads;
+	if ( poolCreate(a, name, nThreads ? nThreads : 1, priority) ) {
+		free(a);
+		return 0;
+	}
+	return a;
+}
+
+void
+savresAioSubmit(SavResAio a, SavResAioJob j)
+{
+	j->off    = 0;
+	j->status = 0;
+	j->err    = 0;
+	j->step   = STEP_WRITE;
+#ifdef HAS_IO_URING
+	if ( a->uring ) {
+		if ( 0 == j->hlen + j->n )
+			j->step = j->dosync ? STEP_SYNC : STEP_CLOSE;
+		uringQueue(&a->ur, j);
+		return;
+	}
+#endif
+	epicsMutexMustLock(a->mtx);
+	enq(&a->q, &a->qTail, j);
+	epicsMutexUnlock(a->mtx);
+	epicsEventSignal(a->work);
+}
+
+SavResAioJob
+savresAioReap(SavResAio a, int wait)
+{
+#ifdef HAS_IO_URING
+	if ( a->uring )
+		return uringReap(a, wait);
+#endif
+	return poolReap(a, wait);
+}
+
+const char *
+savresAioBackend(SavResAio a)
+{
+	return a->uring ? "io_uring" : "threads";
+}
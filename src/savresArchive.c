@@ -0,0 +1,662 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "savresUtil.h"
+#include "savresPvt.h"
+
+/* Packed savres archive: a single, preallocated file holding
+ * the data of many records.
+ *
+ * Layout (all numbers are stored big-endian):
+ *
+ *   header   ARCH_HDR_SIZE bytes
+ *   index    maxEntries * ARCH_ENT_SIZE bytes
+ *   data     per entry: two copies of 'cap' bytes each,
+ *            aligned to 'align'
+ *
+ * Every entry owns two copies of its data. A save writes the
+ * copy which is not current and then updates (the 16 bytes
+ * of) that copy's descriptor with a new generation number,
+ * length and checksum. Hence, a crash leaves either the old
+ * or the new version intact; restoring picks the valid copy
+ * with the highest generation.
+ *
+ * Allocation of new entries is append-only; entries are never
+ * removed.
+ */
+
+#define ARCH_MAGIC      "SAVRESAR"
+#define ARCH_VERSION    1
+#define ARCH_HDR_SIZE   512
+#define ARCH_ENT_SIZE   128
+#define ARCH_NAME_SIZE  64
+#define ARCH_ALIGN      4096
+#define ARCH_HASH_SIZE  1024  /* must be a power of 2 */
+
+typedef struct ArchHdrRec_ {
+	char          magic[8];
+	epicsUInt32   version;
+	epicsUInt32   align;
+	epicsUInt32   maxEntries;
+	epicsUInt32   size_hi, size_lo;
+} ArchHdrRec;
+
+typedef struct ArchCopyRec_ {
+	epicsUInt32   gen;      /* 0: never written */
+	epicsUInt32   len;
+	epicsUInt32   csum;
+	epicsUInt32   rsvd;
+} ArchCopyRec;
+
+typedef struct ArchEntRec_ {
+	char          name[ARCH_NAME_SIZE];
+	epicsUInt32   off_hi, off_lo;
+	epicsUInt32   cap;
+	epicsUInt32   rsvd;
+	ArchCopyRec   copy[2];
+	epicsUInt32   pad[4];
+} ArchEntRec;
+
+/* fails to compile if the on-disk entry has the wrong size */
+typedef char ArchEntSizeCheck[ sizeof(ArchEntRec) == ARCH_ENT_SIZE ? 1 : -1 ];
+
+typedef struct ArchSlotRec_ {
+	ArchEntRec    ent;      /* in host byte order (but for the name) */
+	off_t         off;
+	int           next;     /* hash chain */
+	int           busy;     /* being written */
+	int           staged;   /* copy with uncommitted descriptor (or -1) */
+	ArchCopyRec   stage;
+} ArchSlotRec, *ArchSlot;
+
+struct SavResArchiveRec_ {
+	int           fd;
+	epicsMutexId  mtx;
+	unsigned      maxEntries;
+	unsigned      nEntries;
+	off_t         dataEnd;
+	off_t         size;
+	ArchSlot      ents;
+	int           hash[ARCH_HASH_SIZE];
+};
+
+#define ENT_OFF(i)   ( ARCH_HDR_SIZE + (off_t)(i) * ARCH_ENT_SIZE )
+#define COPY_OFF(i,k) ( ENT_OFF(i) + (off_t)((char*)&((ArchEntRec*)0)->copy[k] - (char*)0) )
+
+#define ALIGNUP(x)   ( ((x) + ARCH_ALIGN - 1) & ~((off_t)ARCH_ALIGN - 1) )
+
+/* pread/pwrite are not available everywhere; the fallback
+ * needs the archive lock to keep the file position sane.
+ */
+#if defined(__rtems__) || defined(vxWorks)
+static int
+archIo(SavResArchive a, char *buf, unsigned long n, off_t off, int wr)
+{
+int rval;
+	epicsMutexMustLock( a->mtx );
+	if ( lseek(a->fd, off, SEEK_SET) < 0 )
+		rval = -1;
+	else
+		rval = wr ? write(a->fd, buf, n) : read(a->fd, buf, n);
+	epicsMutexUnlock( a->mtx );
+	return rval;
+}
+#define PREAD(a,b,n,o)  archIo((a),(char*)(b),(n),(o),0)
+#define PWRITE(a,b,n,o) archIo((a),(char*)(b),(n),(o),1)
+#else
+#define PREAD(a,b,n,o)  pread((a)->fd,(b),(n),(o))
+#define PWRITE(a,b,n,o) pwrite((a)->fd,(b),(n),(o))
+#endif
+
+static int
+archXfer(SavResArchive a, char *buf, unsigned long n, off_t off, int wr)
+{
+long got;
+
+	while ( n > 0 ) {
+		if ( (got = wr ? PWRITE(a, buf, n, off) : PREAD(a, buf, n, off)) <= 0 ) {
+			if ( got < 0 && EINTR == errno )
+				continue;
+			return -1;
+		}
+		buf += got;
+		off += got;
+		n   -= got;
+	}
+	return 0;
+}
+
+static void
+copyToDisk(ArchCopyRec *d, ArchCopyRec *s)
+{
+	d->gen  = htonl(s->gen);
+	d->len  = htonl(s->len);
+	d->csum = htonl(s->csum);
+	d->rsvd = 0;
+}
+
+static void
+copyFromDisk(ArchCopyRec *d, ArchCopyRec *s)
+{
+	d->gen  = ntohl(s->gen);
+	d->len  = ntohl(s->len);
+	d->csum = ntohl(s->csum);
+	d->rsvd = 0;
+}
+
+static int
+archSync(SavResArchive a)
+{
+#ifdef __linux__
+	return fdatasync(a->fd);
+#else
+	return fsync(a->fd);
+#endif
+}
+
+static ArchSlot
+archFind(SavResArchive a, const char *nam)
+{
+int i;
+	for ( i = a->hash[savresNameHash(nam) & (ARCH_HASH_SIZE - 1)]; i >= 0; i = a->ents[i].next ) {
+		if ( !strcmp(a->ents[i].ent.name, nam) )
+			return &a->ents[i];
+	}
+	return 0;
+}
+
+static void
+archHashIn(SavResArchive a, ArchSlot e)
+{
+unsigned h = savresNameHash(e->ent.name) & (ARCH_HASH_SIZE - 1);
+	e->next    = a->hash[h];
+	a->hash[h] = e - a->ents;
+}
+
+/* write a complete entry */
+static int
+archPutEnt(SavResArchive a, ArchSlot e)
+{
+ArchEntRec d;
+
+	memset(&d, 0, sizeof(d));
+	strcpy(d.name, e->ent.name);
+	d.off_hi = htonl( (epicsUInt32)( (unsigned long long)e->off >> 32 ) );
+	d.off_lo = htonl( (epicsUInt32)e->off );
+	d.cap    = htonl( e->ent.cap );
+	copyToDisk( &d.copy[0], &e->ent.copy[0] );
+	copyToDisk( &d.copy[1], &e->ent.copy[1] );
+	return archXfer(a, (char*)&d, sizeof(d), ENT_OFF(e - a->ents), 1);
+}
+
+/* reserve space for two copies of 'n' bytes; caller holds the lock */
+static off_t
+archReserve(SavResArchive a, unsigned long n)
+{
+off_t off;
+
+	n = ALIGNUP(n);
+	if ( a->dataEnd + 2 * (off_t)n > a->size )
+		return -1;
+	off         = a->dataEnd;
+	a->dataEnd += 2 * n;
+	return off;
+}
+
+/* add a new entry; caller holds the lock */
+static ArchSlot
+archAlloc(SavResArchive a, const char *nam, unsigned long n)
+{
+ArchSlot e;
+off_t    off;
+
+	if ( strlen(nam) >= ARCH_NAME_SIZE ) {
+		errlogPrintf("savresArchive: name too long: %s\n", nam);
+		return 0;
+	}
+	if ( a->nEntries >= a->maxEntries ) {
+		errlogPrintf("savresArchive: index full; unable to add %s\n", nam);
+		return 0;
+	}
+	if ( (off = archReserve(a, n)) < 0 ) {
+		errlogPrintf("savresArchive: archive full; unable to add %s\n", nam);
+		return 0;
+	}
+
+	e = &a->ents[a->nEntries];
+	memset(e, 0, sizeof(*e));
+	strcpy(e->ent.name, nam);
+	e->off     = off;
+	e->ent.cap = ALIGNUP(n);
+	e->staged  = -1;
+
+	if ( archPutEnt(a, e) ) {
+		errlogPrintf("savresArchive: unable to write index entry: %s\n", strerror(errno));
+		a->dataEnd = off;
+		return 0;
+	}
+
+	a->nEntries++;
+	archHashIn(a, e);
+	return e;
+}
+
+SavResArchive
+savresArchiveOpen(char *path, char *fnam, int maxEntries, int sizeMB)
+{
+SavResArchive  a   = 0;
+char          *s   = 0;
+ArchHdrRec     hdr;
+ArchEntRec    *idx = 0;
+ArchSlot       e;
+int            i, creat = 0;
+off_t          end;
+struct stat    sb;
+
+	if ( ! (s = malloc( (path ? strlen(path) : 0) + strlen(fnam) + 2 )) ) {
+		errlogPrintf("savresArchiveOpen: no memory\n");
+		return 0;
+	}
+	if ( path && '/' != *fnam )
+		sprintf(s, "%s/%s", path, fnam);
+	else
+		strcpy(s, fnam);
+
+	if ( ! (a = calloc(1, sizeof(*a))) ) {
+		errlogPrintf("savresArchiveOpen: no memory\n");
+		goto bail;
+	}
+	a->fd  = -1;
+	a->mtx = epicsMutexMustCreate();
+	for ( i = 0; i < ARCH_HASH_SIZE; i++ )
+		a->hash[i] = -1;
+
+	if ( (a->fd = open(s, O_RDWR, 0)) < 0 ) {
+		if ( ENOENT != errno || (a->fd = open(s, O_RDWR | O_CREAT | O_EXCL, 0664)) < 0 ) {
+			errlogPrintf("savresArchiveOpen: unable to open %s: %s\n", s, strerror(errno));
+			goto bail;
+		}
+		creat = 1;
+	}
+
+	if ( creat ) {
+		if ( maxEntries <= 0 || sizeMB <= 0 ) {
+			errlogPrintf("savresArchiveOpen: need 'maxEntries' and 'sizeMB' to create %s\n", s);
+			unlink(s);
+			goto bail;
+		}
+		a->maxEntries = maxEntries;
+		a->size       = (off_t)sizeMB << 20;
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, ARCH_MAGIC, sizeof(hdr.magic));
+		hdr.version    = htonl(ARCH_VERSION);
+		hdr.align      = htonl(ARCH_ALIGN);
+		hdr.maxEntries = htonl(a->maxEntries);
+		hdr.size_hi    = htonl( (epicsUInt32)( (unsigned long long)a->size >> 32 ) );
+		hdr.size_lo    = htonl( (epicsUInt32)a->size );
+		/* the (zeroed) index is created by extending the file */
+		if ( ftruncate(a->fd, a->size) || archXfer(a, (char*)&hdr, sizeof(hdr), 0, 1) || fsync(a->fd) ) {
+			errlogPrintf("savresArchiveOpen: unable to create %s: %s\n", s, strerror(errno));
+			unlink(s);
+			goto bail;
+		}
+#ifdef __linux__
+		/* try to actually allocate the blocks */
+		posix_fallocate(a->fd, 0, a->size);
+#endif
+	} else {
+		if ( archXfer(a, (char*)&hdr, sizeof(hdr), 0, 0)
+		     || memcmp(hdr.magic, ARCH_MAGIC, sizeof(hdr.magic))
+		     || ARCH_VERSION != ntohl(hdr.version)
+		     || ARCH_ALIGN   != ntohl(hdr.align) ) {
+			errlogPrintf("savresArchiveOpen: %s is not a (compatible) savres archive\n", s);
+			goto bail;
+		}
+		a->maxEntries = ntohl(hdr.maxEntries);
+		a->size       = ((off_t)ntohl(hdr.size_hi) << 16 << 16) | ntohl(hdr.size_lo);
+		if ( fstat(a->fd, &sb) || sb.st_size < a->size ) {
+			errlogPrintf("savresArchiveOpen: %s is truncated\n", s);
+			goto bail;
+		}
+	}
+
+	a->dataEnd = ALIGNUP( ENT_OFF(a->maxEntries) );
+
+	if ( ! (a->ents = calloc(a->maxEntries, sizeof(*a->ents))) ) {
+		errlogPrintf("savresArchiveOpen: no memory\n");
+		goto bail;
+	}
+
+	if ( ! creat ) {
+		/* one pass over the index */
+		if ( ! (idx = malloc( a->maxEntries * sizeof(*idx) )) ) {
+			errlogPrintf("savresArchiveOpen: no memory\n");
+			goto bail;
+		}
+		if ( archXfer(a, (char*)idx, a->maxEntries * sizeof(*idx), ENT_OFF(0), 0) ) {
+			errlogPrintf("savresArchiveOpen: unable to read index: %s\n", strerror(errno));
+			goto bail;
+		}
+		for ( i = 0; i < a->maxEntries && idx[i].name[0]; i++ ) {
+			e = &a->ents[i];
+			memcpy(e->ent.name, idx[i].name, sizeof(e->ent.name));
+			e->ent.name[ARCH_NAME_SIZE - 1] = 0;
+			e->off     = ((off_t)ntohl(idx[i].off_hi) << 16 << 16) | ntohl(idx[i].off_lo);
+			e->ent.cap = ntohl(idx[i].cap);
+			e->staged  = -1;
+			copyFromDisk( &e->ent.copy[0], &idx[i].copy[0] );
+			copyFromDisk( &e->ent.copy[1], &idx[i].copy[1] );
+			archHashIn(a, e);
+			if ( (end = e->off + 2 * (off_t)e->ent.cap) > a->dataEnd )
+				a->dataEnd = end;
+		}
+		a->nEntries = i;
+		free(idx);
+		idx = 0;
+	}
+
+	free(s);
+	return a;
+
+bail:
+	free(idx);
+	free(s);
+	if ( a ) {
+		if ( a->fd >= 0 )
+			close(a->fd);
+		if ( a->mtx )
+			epicsMutexDestroy(a->mtx);
+		free(a->ents);
+		free(a);
+	}
+	return 0;
+}
+
+/* the copy which is not current */
+#define INACTIVE(e) ( (e)->ent.copy[0].gen > (e)->ent.copy[1].gen ? 1 : 0 )
+#define NEXTGEN(e)  ( ( (e)->ent.copy[0].gen > (e)->ent.copy[1].gen ? (e)->ent.copy[0].gen : (e)->ent.copy[1].gen ) + 1 )
+
+/* update a copy descriptor on disk and in memory */
+static int
+archPutCopy(SavResArchive a, ArchSlot e, int k, ArchCopyRec *c)
+{
+ArchCopyRec d;
+
+	copyToDisk(&d, c);
+	if ( archXfer(a, (char*)&d, sizeof(d), COPY_OFF(e - a->ents, k), 1) ) {
+		errlogPrintf("savresArchive: unable to update index (%s): %s\n", e->ent.name, strerror(errno));
+		return -1;
+	}
+	epicsMutexMustLock( a->mtx );
+		e->ent.copy[k] = *c;
+	epicsMutexUnlock( a->mtx );
+	return 0;
+}
+
+int
+savresArchiveDump(SavResArchive a, char *nam, char *buf, int n, int durability)
+{
+	return savresArchiveDumpHdr(a, nam, 0, 0, buf, n, durability);
+}
+
+int
+savresArchiveDumpHdr(SavResArchive a, char *nam, char *hdr, int hlen, char *buf, int n, int durability)
+{
+ArchSlot    e;
+ArchCopyRec c;
+off_t       off, reloc = -1;
+int         k, rval = -1;
+
+	/* header and data are stored as one */
+	n += hlen;
+
+	epicsMutexMustLock( a->mtx );
+	if ( ! (e = archFind(a, nam)) ) {
+		e = archAlloc(a, nam, n);
+	} else if ( e->busy ) {
+		errlogPrintf("savresArchiveDump: concurrent saves of %s\n", nam);
+		e = 0;
+	} else if ( n > e->ent.cap ) {
+		/* grown; move to a new, bigger region */
+		if ( (reloc = archReserve(a, n)) < 0 ) {
+			errlogPrintf("savresArchive: archive full; unable to grow %s\n", nam);
+			e = 0;
+		}
+	}
+	if ( e ) {
+		e->busy   = 1;
+		e->staged = -1;
+		k         = reloc < 0 ? INACTIVE(e) : 0;
+		c.gen     = NEXTGEN(e);
+	}
+	epicsMutexUnlock( a->mtx );
+
+	if ( !e )
+		return -1;
+
+	off    = ( reloc < 0 ? e->off : reloc ) + k * (off_t)( reloc < 0 ? e->ent.cap : ALIGNUP(n) );
+	c.len  = n;
+	c.csum = savresChecksumCont(savresChecksum(hdr, hlen), buf, n - hlen);
+	c.rsvd = 0;
+
+	if ( ( hlen > 0 && archXfer(a, hdr, hlen, off, 1) ) || archXfer(a, buf, n - hlen, off + hlen, 1) ) {
+		errlogPrintf("savresArchiveDump: error writing data (%s): %s\n", nam, strerror(errno));
+		goto bail;
+	}
+
+	if ( reloc >= 0 ) {
+		/* the new data must be safe before the entry points to them */
+		if ( archSync(a) )
+			goto bail;
+		epicsMutexMustLock( a->mtx );
+			e->off        = reloc;
+			e->ent.cap    = ALIGNUP(n);
+			e->ent.copy[0] = c;
+			memset(&e->ent.copy[1], 0, sizeof(e->ent.copy[1]));
+		epicsMutexUnlock( a->mtx );
+		if ( archPutEnt(a, e) || archSync(a) )
+			goto bail;
+	} else if ( SAVRES_DURABLE_BATCH == durability ) {
+		/* descriptor is written by savresArchiveCommit() */
+		epicsMutexMustLock( a->mtx );
+			e->staged = k;
+			e->stage  = c;
+		epicsMutexUnlock( a->mtx );
+	} else {
+		if ( SAVRES_DURABLE_SYNC == durability && archSync(a) )
+			goto bail;
+		if ( archPutCopy(a, e, k, &c) )
+			goto bail;
+		if ( SAVRES_DURABLE_SYNC == durability && archSync(a) )
+			goto bail;
+	}
+
+	rval = 0;
+
+bail:
+	epicsMutexMustLock( a->mtx );
+		e->busy = 0;
+	epicsMutexUnlock( a->mtx );
+	return rval;
+}
+
+int
+savresArchiveCommit(SavResArchive a, char *nam)
+{
+ArchSlot    e;
+ArchCopyRec c;
+int         k = -1;
+
+	epicsMutexMustLock( a->mtx );
+	if ( (e = archFind(a, nam)) && (k = e->staged) >= 0 ) {
+		c         = e->stage;
+		e->staged = -1;
+	}
+	epicsMutexUnlock( a->mtx );
+
+	return k < 0 ? 0 : archPutCopy(a, e, k, &c);
+}
+
+int
+savresArchiveSync(SavResArchive a)
+{
+int rval;
+	if ( (rval = archSync(a)) )
+		errlogPrintf("savresArchiveSync: %s\n", strerror(errno));
+	return rval;
+}
+
+/* snapshot of an entry's copy descriptors */
+static ArchSlot
+archGetCopies(SavResArchive a, char *nam, ArchCopyRec *c, off_t *poff, off_t *pcap)
+{
+ArchSlot e;
+
+	epicsMutexMustLock( a->mtx );
+	if ( (e = archFind(a, nam)) ) {
+		c[0]  = e->ent.copy[0];
+		c[1]  = e->ent.copy[1];
+		*poff = e->off;
+		*pcap = e->ent.cap;
+	}
+	epicsMutexUnlock( a->mtx );
+	return e;
+}
+
+/* newest copy first */
+#define FIRSTCOPY(c) ( (c)[0].gen > (c)[1].gen ? 0 : 1 )
+
+int
+savresArchiveMap(SavResArchive a, char *nam, SavResView v)
+{
+ArchCopyRec c[2];
+off_t       off, cap;
+int         k, i, st;
+
+	memset(v, 0, sizeof(*v));
+
+	if ( ! archGetCopies(a, nam, c, &off, &cap) )
+		return -1;
+
+	for ( i = 0, k = FIRSTCOPY(c); i < 2; i++, k ^= 1 ) {
+		if ( ! c[k].gen )
+			continue;
+#ifndef HAS_MMAP
+		/* falls back to lseek/read which must not race with archIo */
+		epicsMutexMustLock( a->mtx );
+#endif
+		st = savresViewMap(a->fd, off + k * cap, c[k].len, v);
+#ifndef HAS_MMAP
+		epicsMutexUnlock( a->mtx );
+#endif
+		if ( st )
+			continue;
+		if ( savresChecksum(v->data, v->n) != c[k].csum ) {
+			errlogPrintf("savresArchiveMap: checksum error (%s, copy %i)\n", nam, k);
+			savresUnmapData(v);
+			continue;
+		}
+		if ( savresViewDecode(v) ) {
+			savresUnmapData(v);
+			continue;
+		}
+		return v->n;
+	}
+	return -1;
+}
+
+/* restore through a view (headers and compressed
+ * data are decoded by savresArchiveMap).
+ */
+static int
+archRstrView(SavResArchive a, char *nam, char *buf, int n, int type, unsigned long nelm)
+{
+SavResViewRec v;
+int           got;
+
+	if ( (got = savresArchiveMap(a, nam, &v)) < 0 )
+		return -1;
+	if ( savresViewCheck(&v, type, nelm, nam) ) {
+		savresUnmapData(&v);
+		return -1;
+	}
+	if ( got > n )
+		got = n;
+	savresCopy(buf, v.data, got);
+	savresUnmapData(&v);
+	return got;
+}
+
+int
+savresArchiveRstr(SavResArchive a, char *nam, char *buf, int n)
+{
+	return savresArchiveRstrTyped(a, nam, buf, n, SAVRES_TYPE_RAW, 0);
+}
+
+int
+savresArchiveRstrTyped(SavResArchive a, char *nam, char *buf, int n, int type, unsigned long nelm)
+{
+ArchCopyRec c[2];
+off_t       off, cap;
+int         k, i, got;
+char        *p;
+
+#ifdef HAS_MMAP
+	/* big ones are mapped and copied in one go */
+	if ( n >= MMAP_MIN )
+		return archRstrView(a, nam, buf, n, type, nelm);
+#endif
+
+	if ( ! archGetCopies(a, nam, c, &off, &cap) )
+		return -1;
+
+	/* newest first; fall back to the other copy if it is bad */
+	for ( i = 0, k = FIRSTCOPY(c); i < 2; i++, k ^= 1 ) {
+		if ( ! c[k].gen )
+			continue;
+		/* doesn't fit 'buf' (has a header or is truncated) */
+		if ( c[k].len > n )
+			return archRstrView(a, nam, buf, n, type, nelm);
+		got = c[k].len;
+		if ( archXfer(a, buf, got, off + k * cap, 0) ) {
+			errlogPrintf("savresArchiveRstr: error reading data (%s): %s\n", nam, strerror(errno));
+			continue;
+		}
+		if ( savresChecksum(buf, got) != c[k].csum ) {
+			errlogPrintf("savresArchiveRstr: checksum error (%s, copy %i)\n", nam, k);
+			continue;
+		}
+		if ( savresIsEncoded(buf, got) ) {
+			if ( ! (p = malloc(got)) ) {
+				errlogPrintf("savresArchiveRstr: no memory\n");
+				return -1;
+			}
+			memcpy(p, buf, got);
+			got = savresDecodeTyped(buf, n, p, got, type, nelm, nam);
+			free(p);
+			if ( got < 0 )
+				continue;
+		}
+		return got;
+	}
+	return -1;
+}
+
+void
+savresArchiveClose(SavResArchive a)
+{
+	if ( a ) {
+		close(a->fd);
+		epicsMutexDestroy(a->mtx);
+		free(a->ents);
+		free(a);
+	}
+}
@@ -0,0 +1,590 @@
+/* Stand-alone benchmark of the savres file I/O routines.
+ *
+ * Measures throughput and per-call latency of savresDumpData/
+ * savresRstrData (and the typed/compressed variants) for a
+ * range of array sizes and record (file) counts, with and
+ * without fsync. Results are written to stdout as CSV, one
+ * line per operation and configuration; progress and errors
+ * go to stderr.
+ *
+ * Not part of the IOC library; built for the host with
+ *
+ *   make -C O.$(EPICS_HOST_ARCH) savresBench
+ *
+ * or by hand
+ *
+ *   cc -O2 -DNO_EPICS -DTESTING -o savresBench savresBench.c \
+ *      savres.c savresArchive.c savresCodec.c -lrt
+ *
+ * Run 'savresBench -h' for the options.
+ */
+
+#ifdef TESTING
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "savresUtil.h"
+
+#define FNAM_FMT   "savresBench%05i"
+
+#define FMT_RAW    0	/* savresDumpData                      */
+#define FMT_TYPED  1	/* savresDumpDataTyped, no compression */
+#define FMT_SDLZ   2	/* savresDumpDataTyped, SDLZ codec     */
+
+static const char *fmtNames[] = { "raw", "typed", "sdlz", 0 };
+
+typedef struct Lst_ {
+	int           n;
+	unsigned long v[64];
+} Lst;
+
+static char          *dir     = ".";
+static int            reps    = 10;
+static double         budget  = 1024.*1024.*1024.;  /* bytes per point    */
+static double         maxDisk = 1024.*1024.*1024.;  /* files per point    */
+static int            cold    = 0;
+static int            keep    = 0;
+static int            verify  = 1;
+static int            order   = 0;
+
+static double
+tnow(void)
+{
+struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1.0E-9;
+}
+
+static int
+dcmp(const void *a, const void *b)
+{
+double x = *(const double*)a;
+double y = *(const double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* parse '<number>[k|M|G]' (powers of 1024) */
+static int
+parseSize(const char *s, unsigned long *pv)
+{
+char          *e;
+unsigned long  v = strtoul(s, &e, 0);
+
+	switch ( *e ) {
+		case 'k': case 'K': v <<= 10; e++; break;
+		case 'm': case 'M': v <<= 20; e++; break;
+		case 'g': case 'G': v <<= 30; e++; break;
+		default: break;
+	}
+	if ( e == s || *e || 0 == v )
+		return -1;
+	*pv = v;
+	return 0;
+}
+
+/* comma-separated list of sizes */
+static int
+parseLst(const char *s, Lst *l)
+{
+char *c = strdup(s);
+char *t, *p;
+int   rval = 0;
+
+	l->n = 0;
+	for ( t = strtok_r(c, ",", &p); t; t = strtok_r(0, ",", &p) ) {
+		if ( l->n >= sizeof(l->v)/sizeof(l->v[0]) || parseSize(t, &l->v[l->n]) ) {
+			rval = -1;
+			break;
+		}
+		l->n++;
+	}
+	free(c);
+	return rval || 0 == l->n ? -1 : 0;
+}
+
+static int
+parseFmts(const char *s, Lst *l)
+{
+char *c = strdup(s);
+char *t, *p;
+int   i, rval = 0;
+
+	l->n = 0;
+	for ( t = strtok_r(c, ",", &p); t && !rval; t = strtok_r(0, ",", &p) ) {
+		for ( i = 0; fmtNames[i] && strcmp(t, fmtNames[i]); i++ )
+			;
+		if ( !fmtNames[i] || l->n >= sizeof(l->v)/sizeof(l->v[0]) )
+			rval = -1;
+		else
+			l->v[l->n++] = i;
+	}
+	free(c);
+	return rval || 0 == l->n ? -1 : 0;
+}
+
+/* Something resembling real waveform data: a smooth curve
+ * with a little noise (which defeats trivial compression).
+ */
+static void
+fill(char *buf, unsigned long n, unsigned seed)
+{
+double        *d = (double*)buf;
+unsigned long  i;
+
+	srand(seed);
+	for ( i = 0; i < n/sizeof(*d); i++ )
+		d[i] = (double)((i + seed) % 1000) * 0.001 + (double)(rand() & 0xff) * 1.0E-9;
+	for ( i *= sizeof(*d); i < n; i++ )
+		buf[i] = rand();
+}
+
+static int
+dump(int fmt, char *fnam, char *buf, unsigned long n)
+{
+	if ( FMT_RAW == fmt )
+		return savresDumpData(dir, fnam, buf, n);
+	if ( n % sizeof(double) )
+		return savresDumpDataTyped(dir, fnam, buf, n, SAVRES_TYPE_UCHAR,
+		                           FMT_SDLZ == fmt ? SAVRES_CODEC_SDLZ : SAVRES_CODEC_NONE);
+	return savresDumpDataTyped(dir, fnam, buf, n/sizeof(double), SAVRES_TYPE_DOUBLE,
+	                           FMT_SDLZ == fmt ? SAVRES_CODEC_SDLZ : SAVRES_CODEC_NONE);
+}
+
+/* evict a file from the page cache so it is read from the device */
+static void
+evict(char *fnam)
+{
+#ifdef POSIX_FADV_DONTNEED
+char s[1024];
+int  fd;
+
+	snprintf(s, sizeof(s), "%s/%s", dir, fnam);
+	if ( (fd = open(s, O_RDONLY)) >= 0 ) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#endif
+}
+
+static unsigned long
+fileSize(char *fnam)
+{
+char        s[1024];
+struct stat st;
+
+	snprintf(s, sizeof(s), "%s/%s", dir, fnam);
+	return stat(s, &st) ? 0 : (unsigned long)st.st_size;
+}
+
+static void
+report(const char *op, int fmt, int sync, unsigned long n, int nrec, double *lat, int nops, double tot, double disk)
+{
+double sum = 0.;
+int    i;
+
+	for ( i = 0; i < nops; i++ )
+		sum += lat[i];
+	qsort(lat, nops, sizeof(*lat), dcmp);
+
+	printf("%s,%s,%i,%i,%lu,%i,%i,%.0f,%.6f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%i\n",
+		op, fmtNames[fmt], sync, cold, n, nrec, nops,
+		disk,
+		tot,
+		(double)n * nops / tot / 1.0E6,
+		nops / tot,
+		lat[0]          * 1.0E6,
+		sum / nops      * 1.0E6,
+		lat[nops/2]     * 1.0E6,
+		lat[(nops*99)/100] * 1.0E6,
+		lat[nops-1]     * 1.0E6,
+		savresUncachedMin);
+	fflush(stdout);
+}
+
+/* One configuration: 'r' rounds of saving and restoring 'nrec' files of 'n' bytes */
+static int
+point(int fmt, int sync, unsigned long n, int nrec, char *wbuf, char *rbuf)
+{
+char    fnam[40];
+double *lat;
+double  t, tot, disk = 0.;
+int     r, i, k, got;
+int     rval = -1;
+
+	if ( (double)n * nrec > maxDisk ) {
+		fprintf(stderr, "skipping %s n=%lu records=%i (exceeds -M)\n", fmtNames[fmt], n, nrec);
+		return 0;
+	}
+	if ( (r = budget / ((double)n * nrec)) > reps )
+		r = reps;
+	if ( r < 1 )
+		r = 1;
+
+	if ( ! (lat = malloc(sizeof(*lat) * r * nrec)) ) {
+		fprintf(stderr, "no memory\n");
+		return -1;
+	}
+
+	savresDurability = sync ? SAVRES_DURABLE_SYNC : SAVRES_DURABLE_NONE;
+
+	fill(wbuf, n, n);
+
+	/* save */
+	tot = 0.;
+	for ( k = 0; k < r; k++ ) {
+		for ( i = 0; i < nrec; i++ ) {
+			snprintf(fnam, sizeof(fnam), FNAM_FMT, i);
+			t = tnow();
+			if ( dump(fmt, fnam, wbuf, n) ) {
+				fprintf(stderr, "saving %s/%s failed\n", dir, fnam);
+				goto bail;
+			}
+			lat[k*nrec + i] = tnow() - t;
+			tot += lat[k*nrec + i];
+		}
+	}
+	for ( i = 0; i < nrec; i++ ) {
+		snprintf(fnam, sizeof(fnam), FNAM_FMT, i);
+		disk += fileSize(fnam);
+	}
+	report("save", fmt, sync, n, nrec, lat, r*nrec, tot, disk);
+
+	/* restore */
+	tot = 0.;
+	for ( k = 0; k < r; k++ ) {
+		if ( cold ) {
+			for ( i = 0; i < nrec; i++ ) {
+				snprintf(fnam, sizeof(fnam), FNAM_FMT, i);
+				evict(fnam);
+			}
+		}
+		for ( i = 0; i < nrec; i++ ) {
+			snprintf(fnam, sizeof(fnam), FNAM_FMT, i);
+			if ( verify && 0 == k )
+				memset(rbuf, 0, n);
+			t = tnow();
+			got = savresRstrData(dir, fnam, rbuf, n);
+			lat[k*nrec + i] = tnow() - t;
+			tot += lat[k*nrec + i];
+			if ( got != n ) {
+				fprintf(stderr, "restoring %s/%s failed (got %i of %lu bytes)\n", dir, fnam, got, n);
+				goto bail;
+			}
+			if ( verify && 0 == k && memcmp(rbuf, wbuf, n) ) {
+				fprintf(stderr, "restoring %s/%s: data differ\n", dir, fnam);
+				goto bail;
+			}
+		}
+	}
+	report("restore", fmt, sync, n, nrec, lat, r*nrec, tot, disk);
+
+	rval = 0;
+
+bail:
+	free(lat);
+	return rval;
+}
+
+static void
+cleanup(int nrec)
+{
+char fnam[40], s[1100];
+int  i;
+
+	for ( i = 0; i < nrec; i++ ) {
+		snprintf(fnam, sizeof(fnam), FNAM_FMT, i);
+		snprintf(s, sizeof(s), "%s/%s", dir, fnam);
+		unlink(s);
+		snprintf(s, sizeof(s), "%s/%s.tmp", dir, fnam);
+		unlink(s);
+	}
+}
+
+/* Compressed (SDLZ) files holding the same 48 LONGs (see
+ * fixtureVal), written on a little-endian ('L') and on a
+ * big-endian ('B') host; the '0' variants are what versions
+ * that did not yet record the byte order of the deltas wrote.
+ * Whatever the host, half of these come from the other order.
+ */
+#define FIXTURE_NELM 48
+
+static long
+fixtureVal(int i)
+{
+	return -5000 + 1234*i - (i*i*i) % 97;
+}
+
+static const unsigned char fixtureL[] = {
+	0x53, 0x41, 0x56, 0x52, 0x01, 0x4c, 0x06, 0x04, 0x00, 0x00, 0x00, 0x30,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x15, 0x98, 0x2b, 0xda,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x52, 0x5a, 0x01,
+	0x01, 0x04, 0x4c, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x54, 0xe6, 0x38, 0x23,
+	0xfa, 0x23, 0x78, 0xd1, 0xcb, 0xbf, 0xad, 0xf6, 0xd8, 0xb4, 0xeb, 0xbb,
+	0xe6, 0xaa, 0xc9, 0xe2, 0xf5, 0xa1, 0x09, 0xa9, 0x05, 0x99, 0xe9, 0xd2,
+	0xb5, 0xf3, 0xca, 0xfc, 0xc7, 0x8c, 0x0d, 0xc6, 0xda, 0xe8, 0x8f, 0xf2,
+	0xee, 0xe4, 0x73, 0x1f, 0xa2, 0xe1, 0xb9, 0xec, 0xb8, 0xdf, 0x00, 0xba,
+	0xcf, 0xde, 0xec, 0x04, 0x01, 0x00, 0x35, 0x05, 0x04, 0x05, 0x11, 0x00,
+	0x05, 0x0a, 0x00, 0x03, 0x09, 0x00, 0x00, 0x07, 0x00, 0x2f, 0xff, 0x00,
+	0x01, 0x00, 0x1b, 0x0f, 0x30, 0x00, 0x1d, 0x00
+};
+
+static const unsigned char fixtureL0[] = {
+	0x53, 0x41, 0x56, 0x52, 0x01, 0x4c, 0x06, 0x04, 0x00, 0x00, 0x00, 0x30,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0xfa, 0xd1, 0x2b, 0x8e,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x52, 0x5a, 0x01,
+	0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x54, 0xe6, 0x38, 0x23,
+	0xfa, 0x23, 0x78, 0xd1, 0xcb, 0xbf, 0xad, 0xf6, 0xd8, 0xb4, 0xeb, 0xbb,
+	0xe6, 0xaa, 0xc9, 0xe2, 0xf5, 0xa1, 0x09, 0xa9, 0x05, 0x99, 0xe9, 0xd2,
+	0xb5, 0xf3, 0xca, 0xfc, 0xc7, 0x8c, 0x0d, 0xc6, 0xda, 0xe8, 0x8f, 0xf2,
+	0xee, 0xe4, 0x73, 0x1f, 0xa2, 0xe1, 0xb9, 0xec, 0xb8, 0xdf, 0x00, 0xba,
+	0xcf, 0xde, 0xec, 0x04, 0x01, 0x00, 0x35, 0x05, 0x04, 0x05, 0x11, 0x00,
+	0x05, 0x0a, 0x00, 0x03, 0x09, 0x00, 0x00, 0x07, 0x00, 0x2f, 0xff, 0x00,
+	0x01, 0x00, 0x1b, 0x0f, 0x30, 0x00, 0x1d, 0x00
+};
+
+static const unsigned char fixtureB[] = {
+	0x53, 0x41, 0x56, 0x52, 0x01, 0x42, 0x06, 0x04, 0x00, 0x00, 0x00, 0x30,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x53, 0x5f, 0x2a, 0xeb,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x52, 0x5a, 0x01,
+	0x01, 0x04, 0x42, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x0b, 0x36, 0x38, 0x23,
+	0x2f, 0xff, 0x00, 0x01, 0x00, 0x1b, 0x0f, 0x30, 0x00, 0x1d, 0x2a, 0xec,
+	0x04, 0x01, 0x00, 0x35, 0x05, 0x04, 0x05, 0x11, 0x00, 0x05, 0x0a, 0x00,
+	0x03, 0x09, 0x00, 0x00, 0x07, 0x00, 0xf0, 0x21, 0x78, 0xd1, 0xcb, 0xbf,
+	0xad, 0xf6, 0xd8, 0xb4, 0xeb, 0xbb, 0xe6, 0xaa, 0xc9, 0xe2, 0xf5, 0xa1,
+	0x09, 0xa9, 0x05, 0x99, 0xe9, 0xd2, 0xb5, 0xf3, 0xca, 0xfc, 0xc7, 0x8c,
+	0x0d, 0xc6, 0xda, 0xe8, 0x8f, 0xf2, 0xee, 0xe4, 0x73, 0x1f, 0xa2, 0xe1,
+	0xb9, 0xec, 0xb8, 0xdf, 0x00, 0xba, 0xcf, 0xde
+};
+
+static const unsigned char fixtureB0[] = {
+	0x53, 0x41, 0x56, 0x52, 0x01, 0x42, 0x06, 0x04, 0x00, 0x00, 0x00, 0x30,
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x3c, 0x2b, 0x2a, 0xa9,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x52, 0x5a, 0x01,
+	0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0x0b, 0x36, 0x38, 0x23,
+	0x2f, 0xff, 0x00, 0x01, 0x00, 0x1b, 0x0f, 0x30, 0x00, 0x1d, 0x2a, 0xec,
+	0x04, 0x01, 0x00, 0x35, 0x05, 0x04, 0x05, 0x11, 0x00, 0x05, 0x0a, 0x00,
+	0x03, 0x09, 0x00, 0x00, 0x07, 0x00, 0xf0, 0x21, 0x78, 0xd1, 0xcb, 0xbf,
+	0xad, 0xf6, 0xd8, 0xb4, 0xeb, 0xbb, 0xe6, 0xaa, 0xc9, 0xe2, 0xf5, 0xa1,
+	0x09, 0xa9, 0x05, 0x99, 0xe9, 0xd2, 0xb5, 0xf3, 0xca, 0xfc, 0xc7, 0x8c,
+	0x0d, 0xc6, 0xda, 0xe8, 0x8f, 0xf2, 0xee, 0xe4, 0x73, 0x1f, 0xa2, 0xe1,
+	0xb9, 0xec, 0xb8, 0xdf, 0x00, 0xba, 0xcf, 0xde
+};
+
+static const struct {
+	const char          *name;
+	const unsigned char *data;
+	unsigned long        len;
+} fixtures[] = {
+	{ "fixtureL",  fixtureL,  sizeof(fixtureL)  },
+	{ "fixtureL0", fixtureL0, sizeof(fixtureL0) },
+	{ "fixtureB",  fixtureB,  sizeof(fixtureB)  },
+	{ "fixtureB0", fixtureB0, sizeof(fixtureB0) },
+};
+
+/* restore the fixtures (written to 'dir') and compare */
+static int
+checkOrder(void)
+{
+char        fnam[40], s[1100];
+int32_t     v[FIXTURE_NELM];
+int         i, k, fd, got, rval = 0;
+
+	for ( k = 0; k < sizeof(fixtures)/sizeof(fixtures[0]); k++ ) {
+		snprintf(fnam, sizeof(fnam), "savresBench_%s", fixtures[k].name);
+		snprintf(s, sizeof(s), "%s/%s", dir, fnam);
+		if ( (fd = open(s, O_CREAT | O_TRUNC | O_WRONLY, 0664)) < 0
+		     || write(fd, fixtures[k].data, fixtures[k].len) != fixtures[k].len ) {
+			perror("writing fixture");
+			if ( fd >= 0 )
+				close(fd);
+			return 1;
+		}
+		close(fd);
+
+		memset(v, 0, sizeof(v));
+		got = savresRstrData(dir, fnam, (char*)v, sizeof(v));
+		for ( i = 0; i < FIXTURE_NELM && got == sizeof(v); i++ ) {
+			if ( v[i] != fixtureVal(i) )
+				break;
+		}
+		if ( got != sizeof(v) || i < FIXTURE_NELM ) {
+			fprintf(stderr, "%s: FAILED (got %i bytes, first difference at element %i)\n", fixtures[k].name, got, i);
+			rval = 1;
+		} else {
+			fprintf(stderr, "%s: OK\n", fixtures[k].name);
+		}
+		if ( !keep )
+			unlink(s);
+	}
+	return rval;
+}
+
+static void
+usage(char *nm)
+{
+	fprintf(stderr, "Usage: %s [-h] [-d dir] [-s sizes] [-r records] [-f syncs] [-F formats]\n", nm);
+	fprintf(stderr, "          [-n reps] [-b budget] [-M maxdisk] [-u size] [-c] [-k] [-V] [-t]\n\n");
+	fprintf(stderr, "Benchmark savresDumpData/savresRstrData; results are printed as CSV.\n");
+	fprintf(stderr, "  -d dir      directory to create the files in (default: '.')\n");
+	fprintf(stderr, "  -s sizes    array sizes in bytes, comma-separated, with optional\n");
+	fprintf(stderr, "              k/M/G suffix (default: 16,256,4k,64k,1M,16M,256M)\n");
+	fprintf(stderr, "  -r records  numbers of records/files (default: 1,16,256)\n");
+	fprintf(stderr, "  -f syncs    0: no fsync, 1: fsync every file (default: 0,1)\n");
+	fprintf(stderr, "  -F formats  raw, typed (with header), sdlz (compressed) (default: raw)\n");
+	fprintf(stderr, "  -n reps     rounds per configuration (default: 10)\n");
+	fprintf(stderr, "  -b budget   fewer rounds if they'd write more than this (default: 1G)\n");
+	fprintf(stderr, "  -M maxdisk  skip configurations needing more disk space (default: 1G)\n");
+	fprintf(stderr, "  -u size     bypass the page cache for files of this size or bigger\n");
+	fprintf(stderr, "              (savresUncachedMin; default: 0 = never)\n");
+	fprintf(stderr, "  -c          cold restore: evict files from the page cache first\n");
+	fprintf(stderr, "  -k          keep the files\n");
+	fprintf(stderr, "  -V          don't verify the restored data\n");
+	fprintf(stderr, "  -t          just check that files written on little- and big-endian\n");
+	fprintf(stderr, "              hosts restore correctly\n\n");
+	fprintf(stderr, "CSV columns: op,format,fsync,cold,size,records,ops,disk_bytes,seconds,\n");
+	fprintf(stderr, "             MB_per_s,ops_per_s,lat_min_us,lat_avg_us,lat_p50_us,lat_p99_us,lat_max_us,\n");
+	fprintf(stderr, "             uncached_min\n");
+}
+
+int
+main(int argc, char **argv)
+{
+Lst            sizes, recs, syncs, fmts;
+unsigned long  v, nmax = 0;
+int            ch, f, s, i, j, maxrec = 0;
+char          *wbuf, *rbuf;
+int            rval = 0;
+
+	parseLst("16,256,4k,64k,1M,16M,256M", &sizes);
+	parseLst("1,16,256", &recs);
+	syncs.n = 2; syncs.v[0] = 0; syncs.v[1] = 1;
+	fmts.n  = 1; fmts.v[0]  = FMT_RAW;
+
+	while ( (ch = getopt(argc, argv, "hd:s:r:f:F:n:b:M:u:ckVt")) >= 0 ) {
+		switch ( ch ) {
+			case 'd': dir = optarg; break;
+			case 's':
+				if ( parseLst(optarg, &sizes) ) {
+					fprintf(stderr, "invalid size list: %s\n", optarg);
+					return 2;
+				}
+			break;
+			case 'r':
+				if ( parseLst(optarg, &recs) ) {
+					fprintf(stderr, "invalid record count list: %s\n", optarg);
+					return 2;
+				}
+			break;
+			case 'f':
+				syncs.n = 0;
+				for ( i = 0; optarg[i]; i++ ) {
+					if ( ('0' == optarg[i] || '1' == optarg[i]) && syncs.n < 2 ) {
+						syncs.v[syncs.n++] = optarg[i] - '0';
+					} else if ( ',' != optarg[i] ) {
+						fprintf(stderr, "invalid fsync list: %s\n", optarg);
+						return 2;
+					}
+				}
+			break;
+			case 'F':
+				if ( parseFmts(optarg, &fmts) ) {
+					fprintf(stderr, "invalid format list: %s\n", optarg);
+					return 2;
+				}
+			break;
+			case 'n':
+				if ( (reps = atoi(optarg)) < 1 ) {
+					fprintf(stderr, "invalid number of rounds: %s\n", optarg);
+					return 2;
+				}
+			break;
+			case 'b':
+				if ( parseSize(optarg, &v) ) {
+					fprintf(stderr, "invalid budget: %s\n", optarg);
+					return 2;
+				}
+				budget = v;
+			break;
+			case 'M':
+				if ( parseSize(optarg, &v) ) {
+					fprintf(stderr, "invalid disk limit: %s\n", optarg);
+					return 2;
+				}
+				maxDisk = v;
+			break;
+			case 'u':
+				if ( strcmp(optarg, "0") && ( parseSize(optarg, &v) || v > 0x7fffffffUL ) ) {
+					fprintf(stderr, "invalid size: %s\n", optarg);
+					return 2;
+				}
+				savresUncachedMin = strcmp(optarg, "0") ? v : 0;
+			break;
+			case 'c': cold   = 1; break;
+			case 'k': keep   = 1; break;
+			case 'V': verify = 0; break;
+			case 't': order  = 1; break;
+			case 'h': usage(argv[0]); return 0;
+			default:  usage(argv[0]); return 2;
+		}
+	}
+
+	if ( order )
+		return checkOrder();
+
+	for ( i = 0; i < sizes.n; i++ ) {
+		if ( sizes.v[i] > 0x7fffffffUL ) {
+			fprintf(stderr, "size %lu too big\n", sizes.v[i]);
+			return 2;
+		}
+		if ( sizes.v[i] > nmax )
+			nmax = sizes.v[i];
+	}
+	for ( i = 0; i < recs.n; i++ ) {
+		if ( recs.v[i] > 99999 ) {
+			fprintf(stderr, "too many records: %lu\n", recs.v[i]);
+			return 2;
+		}
+		if ( recs.v[i] > maxrec )
+			maxrec = recs.v[i];
+	}
+
+	if ( ! (wbuf = malloc(nmax)) || ! (rbuf = malloc(nmax)) ) {
+		fprintf(stderr, "no memory for %lu-byte buffers\n", nmax);
+		return 1;
+	}
+
+	printf("op,format,fsync,cold,size,records,ops,disk_bytes,seconds,MB_per_s,ops_per_s,"
+	       "lat_min_us,lat_avg_us,lat_p50_us,lat_p99_us,lat_max_us,uncached_min\n");
+
+	for ( f = 0; f < fmts.n && !rval; f++ ) {
+		for ( s = 0; s < syncs.n && !rval; s++ ) {
+			for ( i = 0; i < sizes.n && !rval; i++ ) {
+				for ( j = 0; j < recs.n && !rval; j++ ) {
+					fprintf(stderr, "%s fsync=%lu size=%lu records=%lu\n",
+						fmtNames[fmts.v[f]], syncs.v[s], sizes.v[i], recs.v[j]);
+					rval = point(fmts.v[f], syncs.v[s], sizes.v[i], recs.v[j], wbuf, rbuf);
+					if ( !keep )
+						cleanup(recs.v[j]);
+				}
+			}
+		}
+	}
+
+	free(wbuf);
+	free(rbuf);
+	return rval ? 1 : 0;
+}
+
+#endif
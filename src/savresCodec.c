@@ -0,0 +1,633 @@
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "savresUtil.h"
+#include "savresPvt.h"
+
+/* Compressed ('packed') savres data.
+ *
+ * Layout (numbers are stored big-endian):
+ *
+ *   magic    4 bytes  PACK_MAGIC
+ *   codec    1 byte
+ *   esz      1 byte   element size the data were shuffled for
+ *   order    1 byte   'B' or 'L': byte order of the elements
+ *                     the deltas were computed on (0 in data
+ *                     written by older versions; the order of
+ *                     the file header or the host's is assumed)
+ *   rsvd     1 byte
+ *   rawlen   4 bytes  length of the uncompressed data
+ *   csum     4 bytes  Adler-32 of the uncompressed data
+ *   payload
+ *
+ * SAVRES_CODEC_SDLZ: the elements are replaced by their
+ * difference to the predecessor (integer arithmetic on the
+ * bit pattern; lossless also for floating-point data) and
+ * then shuffled so that all first bytes come first, followed
+ * by all second bytes etc. Smooth curves and sparse tables
+ * thus turn into long runs which are finally compressed by
+ * a simple LZ77 scheme (similar to LZ4's block format):
+ *
+ *   token    1 byte: literal count (high nibble),
+ *                    match length - PACK_MINMATCH (low nibble);
+ *                    15 means more length bytes follow (each
+ *                    adding up to 255)
+ *   literals
+ *   offset   2 bytes (little-endian), not present after
+ *            the last literals.
+ */
+
+#define PACK_MAGIC     "SRZ\001"
+#define PACK_MINMATCH  4
+#define PACK_MAXOFF    65535
+#define PACK_HBITS     SAVRES_PACK_HBITS
+
+#define GET32(p) ( ((epicsUInt32)(p)[0]<<24) | ((epicsUInt32)(p)[1]<<16) | ((epicsUInt32)(p)[2]<<8) | (p)[3] )
+
+static void
+put32(unsigned char *p, epicsUInt32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >>  8;
+	p[3] = v;
+}
+
+static int
+nativeOrder(void)
+{
+union { epicsUInt16 s; unsigned char c[2]; } u;
+	u.s = 1;
+	return u.c[0] ? 'L' : 'B';
+}
+
+/* element-wise delta of 'n' elements from 'src' to 'dst' */
+#define DELTA(type, dst, src)                                 \
+	do {                                                      \
+		type prv = 0, cur, d;                                 \
+		for ( i = 0; i < n; i++ ) {                           \
+			memcpy(&cur, (src) + i*sizeof(type), sizeof(type)); \
+			d   = cur - prv;                                  \
+			prv = cur;                                        \
+			memcpy((dst) + i*sizeof(type), &d, sizeof(type)); \
+		}                                                     \
+	} while (0)
+
+#define UNDELTA(type)                                 \
+	do {                                              \
+		type prv = 0, cur;                            \
+		for ( i = 0; i < n; i++ ) {                   \
+			memcpy(&cur, buf + i*sizeof(type), sizeof(type)); \
+			prv += cur;                               \
+			memcpy(buf + i*sizeof(type), &prv, sizeof(type)); \
+		}                                             \
+	} while (0)
+
+/* delta + shuffle 'src' into 'dst' (via 'tmp') */
+static void
+shuffle(unsigned char *dst, const unsigned char *src, unsigned long len, int esz, unsigned char *tmp)
+{
+unsigned long i, n = len / esz;
+int           b;
+
+	switch ( esz ) {
+		case 2:  DELTA(epicsUInt16,        tmp, src); break;
+		case 4:  DELTA(epicsUInt32,        tmp, src); break;
+		case 8:  DELTA(unsigned long long, tmp, src); break;
+		default: DELTA(epicsUInt8,         dst, src); return;
+	}
+	for ( b = 0; b < esz; b++ ) {
+		for ( i = 0; i < n; i++ )
+			dst[b*n + i] = tmp[i*esz + b];
+	}
+	/* trailing partial element */
+	memcpy(dst + n*esz, src + n*esz, len - n*esz);
+}
+
+/* inverse of 'shuffle'; if the deltas were computed in the
+ * other byte order ('swp') the elements are swapped for the
+ * integration and back so that 'buf' ends up holding exactly
+ * what the writer had.
+ */
+static void
+unshuffle(unsigned char *buf, const unsigned char *src, unsigned long len, int esz, int swp)
+{
+unsigned long i, n = len / esz;
+int           b;
+
+	for ( b = 0; b < esz; b++ ) {
+		for ( i = 0; i < n; i++ )
+			buf[i*esz + b] = src[b*n + i];
+	}
+	memcpy(buf + n*esz, src + n*esz, len - n*esz);
+
+	if ( swp )
+		savresSwap((char*)buf, n*esz, esz);
+	switch ( esz ) {
+		case 2:  UNDELTA(epicsUInt16);        break;
+		case 4:  UNDELTA(epicsUInt32);        break;
+		case 8:  UNDELTA(unsigned long long); break;
+		default: UNDELTA(epicsUInt8);         break;
+	}
+	if ( swp )
+		savresSwap((char*)buf, n*esz, esz);
+}
+
+static unsigned char *
+putLen(unsigned char *op, unsigned char *oe, unsigned long l)
+{
+	for ( ; l >= 255; l -= 255 ) {
+		if ( op >= oe )
+			return 0;
+		*op++ = 255;
+	}
+	if ( op >= oe )
+		return 0;
+	*op++ = l;
+	return op;
+}
+
+static unsigned char *
+putSeq(unsigned char *op, unsigned char *oe, const unsigned char *lit, unsigned long nlit, unsigned long mlen, unsigned long off)
+{
+unsigned char *tok = op++;
+
+	if ( op > oe )
+		return 0;
+	*tok = ( nlit < 15 ? nlit : 15 ) << 4;
+	if ( nlit >= 15 && ! (op = putLen(op, oe, nlit - 15)) )
+		return 0;
+	if ( op + nlit > oe )
+		return 0;
+	memcpy(op, lit, nlit);
+	op += nlit;
+	if ( ! mlen )
+		return op;
+	mlen -= PACK_MINMATCH;
+	*tok |= ( mlen < 15 ? mlen : 15 );
+	if ( op + 2 > oe )
+		return 0;
+	*op++ = off;
+	*op++ = off >> 8;
+	if ( mlen >= 15 && ! (op = putLen(op, oe, mlen - 15)) )
+		return 0;
+	return op;
+}
+
+#define HASH4(p) ( (GET32(p) * 2654435761U) >> (32 - PACK_HBITS) )
+
+/* RETURNS: compressed length or 0 if it doesn't fit into 'cap' */
+static unsigned long
+lzEncode(unsigned char *dst, unsigned long cap, const unsigned char *src, unsigned long n, epicsUInt32 *tbl)
+{
+const unsigned char *ip  = src, *anchor = src, *ref;
+const unsigned char *end = src + n;
+unsigned char       *op  = dst, *oe = dst + cap;
+unsigned long        mlen, miss = 0;
+epicsUInt32          h;
+
+	/* table holds position + 1; 0 means 'empty' */
+	memset(tbl, 0, sizeof(*tbl) << PACK_HBITS);
+
+	while ( ip + PACK_MINMATCH <= end ) {
+		h      = HASH4(ip);
+		ref    = tbl[h] ? src + tbl[h] - 1 : ip;
+		tbl[h] = ip - src + 1;
+		if ( ref >= ip || ip - ref > PACK_MAXOFF || memcmp(ref, ip, PACK_MINMATCH) ) {
+			/* skip faster through incompressible data */
+			ip += 1 + (miss++ >> 6);
+			continue;
+		}
+		miss = 0;
+		for ( mlen = PACK_MINMATCH; ip + mlen < end && ref[mlen] == ip[mlen]; mlen++ )
+			;
+		if ( ! (op = putSeq(op, oe, anchor, ip - anchor, mlen, ip - ref)) )
+			return 0;
+		ip    += mlen;
+		anchor = ip;
+	}
+	if ( ! (op = putSeq(op, oe, anchor, end - anchor, 0, 0)) )
+		return 0;
+	return op - dst;
+}
+
+static int
+getLen(const unsigned char **pip, const unsigned char *ie, unsigned long *l)
+{
+const unsigned char *ip = *pip;
+	do {
+		if ( ip >= ie )
+			return -1;
+		*l += *ip;
+	} while ( 255 == *ip++ );
+	*pip = ip;
+	return 0;
+}
+
+/* RETURNS: 0 if exactly 'n' bytes were decoded, -1 otherwise */
+static int
+lzDecode(unsigned char *dst, unsigned long n, const unsigned char *src, unsigned long len)
+{
+const unsigned char *ip = src, *ie = src + len;
+unsigned char       *op = dst, *oe = dst + n;
+unsigned long        l, off;
+unsigned             tok;
+
+	while ( ip < ie ) {
+		tok = *ip++;
+		l   = tok >> 4;
+		if ( 15 == l && getLen(&ip, ie, &l) )
+			return -1;
+		if ( l > (unsigned long)(ie - ip) || l > (unsigned long)(oe - op) )
+			return -1;
+		memcpy(op, ip, l);
+		op += l;
+		ip += l;
+		if ( ip == ie )
+			break;
+		if ( ip + 2 > ie )
+			return -1;
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		l   = tok & 15;
+		if ( 15 == l && getLen(&ip, ie, &l) )
+			return -1;
+		l += PACK_MINMATCH;
+		if ( ! off || off > (unsigned long)(op - dst) || l > (unsigned long)(oe - op) )
+			return -1;
+		if ( off >= l ) {
+			memcpy(op, op - off, l);
+			op += l;
+		} else {
+			/* overlapping, i.e., a repeated pattern */
+			for ( ; l > 0; l--, op++ )
+				*op = op[-off];
+		}
+	}
+	return op == oe ? 0 : -1;
+}
+
+unsigned long
+savresPack(char *dst, const char *src, unsigned long n, int codec, int esz, char *work)
+{
+unsigned long clen;
+
+	if ( SAVRES_CODEC_SDLZ != codec || n <= SAVRES_PACK_HDR )
+		return 0;
+
+	if ( esz != 2 && esz != 4 && esz != 8 )
+		esz = 1;
+
+	/* 'work' holds the shuffled data and the hash table; the
+	 * delta step goes through 'dst' (which is large enough).
+	 */
+	shuffle((unsigned char*)work, (const unsigned char*)src, n, esz, (unsigned char*)dst);
+
+	clen = lzEncode((unsigned char*)dst + SAVRES_PACK_HDR, n - SAVRES_PACK_HDR - 1, (unsigned char*)work, n,
+	                (epicsUInt32*)(work + SAVRES_PACK_ALIGN(n)));
+	if ( ! clen )
+		return 0;
+
+	memcpy(dst, PACK_MAGIC, 4);
+	dst[4] = codec;
+	dst[5] = esz;
+	dst[6] = nativeOrder();
+	dst[7] = 0;
+	put32((unsigned char*)dst +  8, n);
+	put32((unsigned char*)dst + 12, savresChecksum(src, n));
+	return clen + SAVRES_PACK_HDR;
+}
+
+long
+savresPackedLen(const char *src, unsigned long len)
+{
+const unsigned char *p = (const unsigned char*)src;
+
+	if ( len < SAVRES_PACK_HDR || memcmp(p, PACK_MAGIC, 4) || SAVRES_CODEC_SDLZ != p[4] )
+		return -1;
+	return GET32(p + 8);
+}
+
+/* 'order': byte order to assume if the packed data don't record it */
+static long
+unpack(char *buf, unsigned long n, const char *src, unsigned long len, int order)
+{
+const unsigned char *p = (const unsigned char*)src;
+unsigned long        rlen;
+unsigned char       *tmp, *out;
+long                 rval = -1;
+
+	if ( savresPackedLen(src, len) < 0 )
+		return -1;
+
+	if ( 1 != p[5] && 2 != p[5] && 4 != p[5] && 8 != p[5] ) {
+		errlogPrintf("savresUnpack: invalid element size %u\n", p[5]);
+		return -1;
+	}
+
+	if ( p[6] )
+		order = p[6];
+	if ( 'B' != order && 'L' != order ) {
+		errlogPrintf("savresUnpack: unsupported byte order\n");
+		return -1;
+	}
+
+	rlen = GET32(p + 8);
+
+	/* need the full image if the caller's buffer is short */
+	if ( ! (tmp = malloc( rlen + ( rlen > n ? rlen : 0 ) + 1 )) ) {
+		errlogPrintf("savresUnpack: no memory\n");
+		return -1;
+	}
+	out = rlen > n ? tmp + rlen : (unsigned char*)buf;
+
+	if ( lzDecode(tmp, rlen, p + SAVRES_PACK_HDR, len - SAVRES_PACK_HDR) ) {
+		errlogPrintf("savresUnpack: corrupt data\n");
+		goto bail;
+	}
+	unshuffle(out, tmp, rlen, p[5], order != nativeOrder());
+	if ( savresChecksum(out, rlen) != GET32(p + 12) ) {
+		errlogPrintf("savresUnpack: checksum error\n");
+		goto bail;
+	}
+	if ( rlen > n ) {
+		memcpy(buf, out, n);
+		rval = n;
+	} else {
+		rval = rlen;
+	}
+
+bail:
+	free(tmp);
+	return rval;
+}
+
+long
+savresUnpack(char *buf, unsigned long n, const char *src, unsigned long len)
+{
+	return unpack(buf, n, src, len, nativeOrder());
+}
+
+/* Self-describing file header (SAVRES_FILE_HDR bytes; numbers
+ * are stored big-endian):
+ *
+ *   magic    4 bytes  FILE_MAGIC
+ *   version  1 byte   FILE_VERSION
+ *   order    1 byte   'B' or 'L': byte order of the data
+ *   type     1 byte   SAVRES_TYPE_xxx
+ *   esz      1 byte   element size
+ *   nelm     4 bytes  number of elements
+ *   codec    1 byte   SAVRES_CODEC_xxx of the payload
+ *   rsvd     3 bytes
+ *   len      4 bytes  length of the payload following the header
+ *   csum     4 bytes  Adler-32 of header (with csum = 0) and payload
+ *   rsvd     8 bytes
+ *
+ * The payload holds the raw data or packed data (see above).
+ */
+#define FILE_MAGIC     "SAVR"
+#define FILE_VERSION   1
+
+#define TYPE_SWAPS(t)  ( (t) >= SAVRES_TYPE_SHORT && (t) <= SAVRES_TYPE_ENUM )
+
+int
+savresTypeSize(int type)
+{
+	switch ( type ) {
+		case SAVRES_TYPE_RAW:
+		case SAVRES_TYPE_CHAR:
+		case SAVRES_TYPE_UCHAR:   return 1;
+		case SAVRES_TYPE_STRING:  return 40; /* MAX_STRING_SIZE */
+		case SAVRES_TYPE_SHORT:
+		case SAVRES_TYPE_USHORT:
+		case SAVRES_TYPE_ENUM:    return 2;
+		case SAVRES_TYPE_LONG:
+		case SAVRES_TYPE_ULONG:
+		case SAVRES_TYPE_FLOAT:   return 4;
+		case SAVRES_TYPE_DOUBLE:  return 8;
+		default:
+		break;
+	}
+	return 0;
+}
+
+void
+savresMkHdr(char *hdr, int type, unsigned long nelm, int codec, const char *buf, unsigned long len)
+{
+unsigned char *h = (unsigned char*)hdr;
+
+	memset(h, 0, SAVRES_FILE_HDR);
+	memcpy(h, FILE_MAGIC, 4);
+	h[4] = FILE_VERSION;
+	h[5] = nativeOrder();
+	h[6] = type;
+	h[7] = savresTypeSize(type);
+	put32(h +  8, nelm);
+	h[12] = codec;
+	put32(h + 16, len);
+	put32(h + 20, savresChecksumCont(savresChecksum(h, SAVRES_FILE_HDR), buf, len));
+}
+
+static int
+isFile(const char *src, unsigned long len)
+{
+	return len >= SAVRES_FILE_HDR && ! memcmp(src, FILE_MAGIC, 4);
+}
+
+/* verify header and checksum */
+static int
+hdrCheck(const unsigned char *h, unsigned long len)
+{
+unsigned char c[SAVRES_FILE_HDR];
+
+	if ( FILE_VERSION != h[4] || ( 'B' != h[5] && 'L' != h[5] ) ) {
+		errlogPrintf("savres: unsupported file version/format\n");
+		return -1;
+	}
+	if ( GET32(h + 16) != len - SAVRES_FILE_HDR ) {
+		errlogPrintf("savres: file truncated\n");
+		return -1;
+	}
+	memcpy(c, h, sizeof(c));
+	memset(c + 20, 0, 4);
+	if ( savresChecksumCont(savresChecksum(c, sizeof(c)), h + SAVRES_FILE_HDR, len - SAVRES_FILE_HDR) != GET32(h + 20) ) {
+		errlogPrintf("savres: checksum error\n");
+		return -1;
+	}
+	return 0;
+}
+
+int
+savresIsEncoded(const char *src, unsigned long len)
+{
+	return isFile(src, len) || savresPackedLen(src, len) >= 0;
+}
+
+/* Swap 'esz'-byte elements in 'buf' in place; 16 bytes at a
+ * time where the CPU has a byte-shuffle instruction.
+ */
+void
+savresSwap(char *buf, unsigned long n, int esz)
+{
+unsigned long k;
+char          t;
+#ifdef __SSSE3__
+__m128i       m;
+#endif
+
+	if ( esz < 2 )
+		return;
+
+	n -= n % esz;
+
+#if defined(__SSSE3__)
+	if ( 2 == esz || 4 == esz || 8 == esz ) {
+		switch ( esz ) {
+			case 2:  m = _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14); break;
+			case 4:  m = _mm_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12); break;
+			default: m = _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8); break;
+		}
+		for ( ; n >= 16; n -= 16, buf += 16 )
+			_mm_storeu_si128( (__m128i*)buf, _mm_shuffle_epi8( _mm_loadu_si128( (__m128i*)buf ), m ) );
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	if ( 2 == esz || 4 == esz || 8 == esz ) {
+		uint8x16_t v;
+		for ( ; n >= 16; n -= 16, buf += 16 ) {
+			v = vld1q_u8( (uint8_t*)buf );
+			switch ( esz ) {
+				case 2:  v = vrev16q_u8( v ); break;
+				case 4:  v = vrev32q_u8( v ); break;
+				default: v = vrev64q_u8( v ); break;
+			}
+			vst1q_u8( (uint8_t*)buf, v );
+		}
+	}
+#endif
+
+	/* whatever is left (16 is a multiple of 2, 4 and 8) */
+	for ( ; n > 0; n -= esz, buf += esz ) {
+		for ( k = 0; k < esz/2; k++ ) {
+			t              = buf[k];
+			buf[k]         = buf[esz - 1 - k];
+			buf[esz - 1 - k] = t;
+		}
+	}
+}
+
+/* compare what a header says ('htype', 'hesz', 'hnelm') with what the caller expects */
+static int
+typeCheck(int htype, int hesz, unsigned long hnelm, int type, unsigned long nelm, const char *nam)
+{
+	if ( SAVRES_TYPE_RAW == type || SAVRES_TYPE_RAW == htype )
+		return 0;
+	if ( htype != type || hesz != savresTypeSize(type) ) {
+		errlogPrintf("savres: %s: saved data are of type %i (%i-byte elements), expected type %i; not restored\n",
+		             nam ? nam : "", htype, hesz, type);
+		return -1;
+	}
+	if ( hnelm != nelm ) {
+		errlogPrintf("savres: %s: %lu elements saved, %lu expected; restoring %lu\n",
+		             nam ? nam : "", hnelm, nelm, hnelm < nelm ? hnelm : nelm);
+	}
+	return 0;
+}
+
+long
+savresDecode(char *buf, unsigned long n, const char *src, unsigned long len)
+{
+	return savresDecodeTyped(buf, n, src, len, SAVRES_TYPE_RAW, 0, 0);
+}
+
+long
+savresDecodeTyped(char *buf, unsigned long n, const char *src, unsigned long len, int type, unsigned long nelm, const char *nam)
+{
+const unsigned char *h = (const unsigned char*)src;
+long                 got;
+
+	if ( ! isFile(src, len) )
+		return savresUnpack(buf, n, src, len);
+
+	if ( hdrCheck(h, len) || typeCheck(h[6], h[7], GET32(h + 8), type, nelm, nam) )
+		return -1;
+
+	src += SAVRES_FILE_HDR;
+	len -= SAVRES_FILE_HDR;
+
+	if ( savresPackedLen(src, len) >= 0 ) {
+		if ( (got = unpack(buf, n, src, len, h[5])) < 0 )
+			return -1;
+	} else {
+		got = len < n ? len : n;
+		savresCopy(buf, src, got);
+	}
+
+	if ( h[5] != nativeOrder() && TYPE_SWAPS(h[6]) )
+		savresSwap(buf, got, h[7]);
+
+	return got;
+}
+
+int
+savresViewDecode(SavResView v)
+{
+const unsigned char *h = (const unsigned char*)v->data;
+const char          *p;
+long                 l;
+char                *b;
+
+	if ( ! savresIsEncoded(v->data, v->n) )
+		return 0;
+
+	if ( isFile(v->data, v->n) ) {
+		p = v->data + SAVRES_FILE_HDR;
+		l = v->n    - SAVRES_FILE_HDR;
+		if ( savresPackedLen(p, l) < 0 && ( h[5] == nativeOrder() || ! TYPE_SWAPS(h[6]) ) ) {
+			/* nothing to convert; just skip the header */
+			if ( hdrCheck(h, v->n) )
+				return -1;
+			v->type = h[6];
+			v->esz  = h[7];
+			v->nelm = GET32(h + 8);
+			v->data = p;
+			v->n    = l;
+			return 0;
+		}
+		if ( savresPackedLen(p, l) >= 0 )
+			l = savresPackedLen(p, l);
+	} else {
+		l = savresPackedLen(v->data, v->n);
+	}
+
+	if ( ! (b = malloc(l ? l : 1)) ) {
+		errlogPrintf("savresViewDecode: no memory\n");
+		return -1;
+	}
+	if ( savresDecode(b, l, v->data, v->n) != l ) {
+		free(b);
+		return -1;
+	}
+	if ( isFile(v->data, v->n) ) {
+		v->type = h[6];
+		v->esz  = h[7];
+		v->nelm = GET32(h + 8);
+	}
+	savresUnmapData(v);
+	v->base   = b;
+	v->data   = b;
+	v->n      = l;
+	v->mlen   = l;
+	v->mapped = 0;
+	return 0;
+}
+
+int
+savresViewCheck(SavResView v, int type, unsigned long nelm, const char *nam)
+{
+	return typeCheck(v->type, v->esz, v->nelm, type, nelm, nam);
+}
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <dbStaticLib.h>
+#include <errlog.h>
+
+#include "savresUtil.h"
+#include "savresPvt.h"
+
+/* Restore prefetching.
+ *
+ * aaoRstrData is called from every record's init_record, i.e.,
+ * iocInit reads the files one after another and pays the full
+ * latency of each of them. The prefetcher is started before the
+ * records are initialized: it looks up all aao records in the
+ * database and a few threads read (and decode) their files in
+ * parallel into a cache from which aaoRstrData merely copies.
+ *
+ * The files are read in database order which is the order in
+ * which the records are initialized. The cache is bounded; the
+ * threads wait for room once it is full and an entry is released
+ * as soon as its record took the data. A record whose file has
+ * not been started yet (or is waiting for room) reads it itself,
+ * i.e., it only ever waits for a file which is being read.
+ */
+
+#define PF_QUEUED   0  /* not started yet              */
+#define PF_LOADING  1
+#define PF_WAITING  2  /* for room in the cache        */
+#define PF_READY    3
+#define PF_DONE     4  /* taken, failed or not cached  */
+
+typedef struct PfEntRec_ {
+	char           name[PVNAME_STRINGSZ];
+	int            state;
+	int            next;    /* hash chain            */
+	unsigned long  cost;    /* bytes held            */
+	SavResViewRec  v;
+} PfEntRec, *PfEnt;
+
+typedef struct SavResPrefetchRec_ {
+	char          *path;
+	PfEnt          ents;
+	int            nents;
+	int           *hash;
+	unsigned       hmask;
+	int            nextEnt;  /* next one to load */
+	unsigned long  used;
+	unsigned long  size;
+	int            running;
+	int            stop;
+	epicsMutexId   mtx;
+	epicsEventId   room, loaded, idle;
+} SavResPrefetchRec;
+
+#define PF_POLL 0.1
+
+static PfEnt pfFind(SavResPrefetch p, const char *nam)
+{
+int i;
+
+	for ( i = p->hash[savresNameHash(nam) & p->hmask]; i >= 0; i = p->ents[i].next ) {
+		if ( ! strcmp(p->ents[i].name, nam) )
+			return &p->ents[i];
+	}
+	return 0;
+}
+
+/* Wait until 'cost' bytes fit into the cache and charge them.
+ * Called with the lock held.
+ * RETURNS: 0 on success, -1 if the entry is not to be cached
+ *          (too big, or its record came first).
+ */
+static int pfReserve(SavResPrefetch p, PfEnt e, unsigned long cost)
+{
+	if ( cost > p->size )
+		return -1;
+	if ( p->used + cost > p->size ) {
+		e->state = PF_WAITING;
+		epicsEventSignal(p->loaded);
+		do {
+			epicsMutexUnlock(p->mtx);
+			epicsEventWaitWithTimeout(p->room, PF_POLL);
+			epicsMutexMustLock(p->mtx);
+			if ( PF_WAITING != e->state || p->stop )
+				return -1;
+		} while ( p->used + cost > p->size );
+		e->state = PF_LOADING;
+	}
+	p->used += cost;
+	e->cost  = cost;
+	/* the event is binary; pass it on if there is room left */
+	if ( p->used < p->size )
+		epicsEventSignal(p->room);
+	return 0;
+}
+
+/* Read and decode a file. Called with the lock held.
+ * RETURNS: 0 on success, -1 if the entry is not cached.
+ */
+static int pfLoad(SavResPrefetch p, PfEnt e)
+{
+struct stat   sb;
+unsigned long len;
+long          got;
+char          *rbuf;
+int           fd, rval = -1;
+
+	epicsMutexUnlock(p->mtx);
+	fd = savresOpenData(p->path, e->name);
+	epicsMutexMustLock(p->mtx);
+
+	/* missing files are reported when the record reads them */
+	if ( fd < 0 )
+		return -1;
+
+	if ( fstat(fd, &sb) || pfReserve(p, e, sb.st_size) )
+		goto bail;
+
+	epicsMutexUnlock(p->mtx);
+	if ( (e->v.base = malloc(sb.st_size ? sb.st_size : 1)) ) {
+		e->v.data   = e->v.base;
+		e->v.n      = sb.st_size;
+		e->v.mlen   = sb.st_size;
+		e->v.mapped = 0;
+		e->v.type   = SAVRES_TYPE_RAW;
+		e->v.esz    = 0;
+		e->v.nelm   = 0;
+		for ( rbuf = e->v.base, len = sb.st_size; len > 0; len -= got, rbuf += got ) {
+			if ( (got = read(fd, rbuf, len)) <= 0 ) {
+				if ( got < 0 && EINTR == errno ) {
+					got = 0;
+					continue;
+				}
+				break;
+			}
+		}
+		if ( len > 0 || savresViewDecode(&e->v) )
+			savresUnmapData(&e->v);
+		else
+			rval = 0;
+	}
+	epicsMutexMustLock(p->mtx);
+
+	/* decoding changes the size */
+	p->used -= e->cost;
+	e->cost  = rval ? 0 : e->v.mlen;
+	p->used += e->cost;
+
+bail:
+	close(fd);
+	return rval;
+}
+
+static void pfWorker(void *arg)
+{
+SavResPrefetch p = arg;
+PfEnt          e;
+
+	epicsMutexMustLock(p->mtx);
+	while ( ! p->stop && p->nextEnt < p->nents ) {
+		e = &p->ents[p->nextEnt++];
+		if ( PF_QUEUED != e->state )
+			continue;
+		e->state = PF_LOADING;
+		if ( pfLoad(p, e) ) {
+			/* a record may have taken over */
+			if ( PF_LOADING == e->state )
+				e->state = PF_DONE;
+		} else {
+			e->state = PF_READY;
+		}
+		epicsMutexUnlock(p->mtx);
+		epicsEventSignal(p->loaded);
+		epicsMutexMustLock(p->mtx);
+	}
+	p->running--;
+	epicsMutexUnlock(p->mtx);
+	epicsEventSignal(p->idle);
+}
+
+/* RETURNS: number of records found or -1 (no memory) */
+static int pfRecords(SavResPrefetch p, int (*skip)(const char *nam))
+{
+DBENTRY  ent;
+long     st;
+int      n = 0, i;
+unsigned h;
+
+	dbInitEntry(pdbbase, &ent);
+	if ( ! dbFindRecordType(&ent, "aao") && (n = dbGetNRecords(&ent)) > 0 ) {
+		for ( p->hmask = 1; p->hmask < 2*n; p->hmask <<= 1 )
+			/* nothing else to do */;
+		if ( ! (p->ents = calloc(n, sizeof(*p->ents))) || ! (p->hash = malloc(p->hmask * sizeof(*p->hash))) ) {
+			n = -1;
+			goto bail;
+		}
+		for ( i = 0; i < p->hmask; i++ )
+			p->hash[i] = -1;
+		p->hmask--;
+		for ( st = dbFirstRecord(&ent); ! st && p->nents < n; st = dbNextRecord(&ent) ) {
+			if ( skip && skip(dbGetRecordName(&ent)) )
+				continue;
+			strncpy(p->ents[p->nents].name, dbGetRecordName(&ent), PVNAME_STRINGSZ - 1);
+			h                          = savresNameHash(p->ents[p->nents].name) & p->hmask;
+			p->ents[p->nents].next     = p->hash[h];
+			p->hash[h]                 = p->nents;
+			p->nents++;
+		}
+	}
+bail:
+	dbFinishEntry(&ent);
+	return n;
+}
+
+SavResPrefetch
+savresPrefetchStart(const char *path, int nThreads, unsigned long size, int priority, int (*skip)(const char *nam))
+{
+SavResPrefetch p;
+char           nam[32];
+int            i, n;
+
+	if ( ! (p = calloc(1, sizeof(*p))) || ( path && ! (p->path = strdup(path)) ) ) {
+		errlogPrintf("savresPrefetchStart: no memory\n");
+		free(p);
+		return 0;
+	}
+	p->size = size;
+
+	if ( (n = pfRecords(p, skip)) < 0 || (n = p->nents) <= 0 ) {
+		if ( n < 0 )
+			errlogPrintf("savresPrefetchStart: no memory\n");
+		goto bail;
+	}
+
+	p->mtx    = epicsMutexMustCreate();
+	p->room   = epicsEventMustCreate(epicsEventEmpty);
+	p->loaded = epicsEventMustCreate(epicsEventEmpty);
+	p->idle   = epicsEventMustCreate(epicsEventEmpty);
+
+	if ( nThreads > n )
+		nThreads = n;
+	for ( i = 0; i < nThreads; i++ ) {
+		sprintf(nam, "savresPrefetch%i", i);
+		epicsMutexMustLock(p->mtx);
+		p->running++;
+		epicsMutexUnlock(p->mtx);
+		if ( ! epicsThreadCreate(nam, priority, epicsThreadGetStackSize(epicsThreadStackSmall), pfWorker, p) ) {
+			errlogPrintf("savresPrefetchStart: unable to create thread\n");
+			epicsMutexMustLock(p->mtx);
+			p->running--;
+			epicsMutexUnlock(p->mtx);
+			/* those we have keep working */
+			break;
+		}
+	}
+	if ( i > 0 )
+		return p;
+
+bail:
+	savresPrefetchStop(p);
+	return 0;
+}
+
+int
+savresPrefetchGet(SavResPrefetch p, const char *nam, SavResView v)
+{
+PfEnt e;
+int   rval = -1;
+
+	epicsMutexMustLock(p->mtx);
+	if ( (e = pfFind(p, nam)) ) {
+		while ( PF_LOADING == e->state ) {
+			epicsMutexUnlock(p->mtx);
+			epicsEventWaitWithTimeout(p->loaded, PF_POLL);
+			epicsMutexMustLock(p->mtx);
+		}
+		if ( PF_READY == e->state ) {
+			*v       = e->v;
+			p->used -= e->cost;
+			e->cost  = 0;
+			e->v.base = 0;
+			rval     = 0;
+		}
+		e->state = PF_DONE;
+	}
+	epicsMutexUnlock(p->mtx);
+	if ( ! rval )
+		epicsEventSignal(p->room);
+	return rval;
+}
+
+void
+savresPrefetchStop(SavResPrefetch p)
+{
+int i;
+
+	if ( ! p )
+		return;
+
+	if ( p->mtx ) {
+		epicsMutexMustLock(p->mtx);
+		p->stop = 1;
+		while ( p->running > 0 ) {
+			epicsMutexUnlock(p->mtx);
+			epicsEventSignal(p->room);
+			epicsEventWaitWithTimeout(p->idle, PF_POLL);
+			epicsMutexMustLock(p->mtx);
+		}
+		epicsMutexUnlock(p->mtx);
+		epicsMutexDestroy(p->mtx);
+		epicsEventDestroy(p->room);
+		epicsEventDestroy(p->loaded);
+		epicsEventDestroy(p->idle);
+	}
+
+	for ( i = 0; i < p->nents; i++ )
+		savresUnmapData(&p->ents[i].v);
+	free(p->ents);
+	free(p->hash);
+	free(p->path);
+	free(p);
+}
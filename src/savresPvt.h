@@ -0,0 +1,275 @@
+#ifndef SAVRES_PVT_H
+#define SAVRES_PVT_H
+
+/* Interfaces shared by the savres modules; not installed */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "savresUtil.h"
+
+#if defined(_POSIX_MAPPED_FILES) && (_POSIX_MAPPED_FILES > 0) && !defined(__rtems__) && !defined(vxWorks)
+#define HAS_MMAP
+#endif
+
+/* files smaller than this are read(); mapping doesn't pay */
+#define MMAP_MIN    (64*1024)
+
+/* vectored I/O; otherwise the segments are transferred one by one */
+#ifndef vxWorks
+#define HAS_WRITEV
+#endif
+#if defined(__linux__)
+#define HAS_PREADV
+#endif
+
+/* names may be resolved relative to a directory descriptor */
+#if defined(__linux__)
+#define HAS_OPENAT
+#endif
+
+/* segments passed to writev/readv at once */
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define IOV_CHUNK   IOV_MAX
+#else
+#define IOV_CHUNK   64
+#endif
+
+#ifdef NO_EPICS
+#include <stdio.h>
+#include <stdint.h>
+
+typedef uint8_t  epicsUInt8;
+typedef uint16_t epicsUInt16;
+typedef uint32_t epicsUInt32;
+
+/* stand-alone (host) tools are single-threaded */
+typedef void *epicsMutexId;
+#define epicsMutexMustCreate()  ((epicsMutexId)0)
+#define epicsMutexMustLock(m)   do {} while (0)
+#define epicsMutexUnlock(m)     do {} while (0)
+#define epicsMutexDestroy(m)    do {} while (0)
+
+#define errlogPrintf printf
+#else
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <errlog.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* hash of a record/file name */
+unsigned
+savresNameHash(const char *nam);
+
+/* Adler-32 checksum of 'n' bytes */
+epicsUInt32
+savresChecksum(const void *buf, unsigned long n);
+
+/* continue a checksum over more data; start with SAVRES_CSUM_INIT */
+#define SAVRES_CSUM_INIT 1
+epicsUInt32
+savresChecksumCont(epicsUInt32 sum, const void *buf, unsigned long n);
+
+/* Copy, using non-temporal stores for big blocks */
+void
+savresCopy(char *dst, const char *src, unsigned long n);
+
+/* Map (or read if mapping is unsupported) 'len' bytes
+ * at 'off' of an open file into a view.
+ */
+int
+savresViewMap(int fd, off_t off, unsigned long len, SavResView v);
+
+/* Compression (see savresCodec.c) */
+#define SAVRES_PACK_HDR       16
+#define SAVRES_PACK_HBITS     12
+#define SAVRES_PACK_ALIGN(n)  ( ((n) + 7) & ~7UL )
+/* size of the work area savresPack needs */
+#define SAVRES_PACK_WORK(n)   ( SAVRES_PACK_ALIGN(n) + (sizeof(epicsUInt32) << SAVRES_PACK_HBITS) )
+
+/* Compress 'n' bytes of 'src' into 'dst' (of size 'n') treating
+ * them as an array of 'esz'-byte elements.
+ *
+ * RETURNS: size of the packed data or 0 if it would not be
+ *          smaller than the original.
+ */
+unsigned long
+savresPack(char *dst, const char *src, unsigned long n, int codec, int esz, char *work);
+
+/* RETURNS: uncompressed size if 'src' holds packed data, -1 otherwise */
+long
+savresPackedLen(const char *src, unsigned long len);
+
+/* Uncompress packed data into 'buf'; at most 'n' bytes are stored.
+ *
+ * RETURNS: number of bytes stored or -1 (not packed or corrupt).
+ */
+long
+savresUnpack(char *buf, unsigned long n, const char *src, unsigned long len);
+
+/* File header (see savresCodec.c) */
+#define SAVRES_FILE_HDR       32
+
+/* Fill in a header for 'len' bytes of payload in 'buf'
+ * which encode 'nelm' elements of 'type'; 'codec' is
+ * the codec used for the payload.
+ */
+void
+savresMkHdr(char *hdr, int type, unsigned long nelm, int codec, const char *buf, unsigned long len);
+
+/* RETURNS: nonzero if 'src' carries a header or packed data */
+int
+savresIsEncoded(const char *src, unsigned long len);
+
+/* Decode (verify header, uncompress, convert byte order) data
+ * for which savresIsEncoded is true into 'buf'; at most 'n'
+ * bytes are stored.
+ *
+ * RETURNS: number of bytes stored or -1 (corrupt).
+ */
+long
+savresDecode(char *buf, unsigned long n, const char *src, unsigned long len);
+
+/* Like savresDecode but data with a header must hold 'type'
+ * (SAVRES_TYPE_xxx) elements; a different type or element
+ * size is rejected, a different number of elements 'nelm'
+ * is reported (the shorter length is restored). 'nam' is
+ * used in messages. SAVRES_TYPE_RAW accepts anything.
+ *
+ * RETURNS: number of bytes stored or -1 (corrupt/mismatch).
+ */
+long
+savresDecodeTyped(char *buf, unsigned long n, const char *src, unsigned long len, int type, unsigned long nelm, const char *nam);
+
+/* Replace encoded data in a view by the decoded data
+ * (views holding raw data are left alone).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresViewDecode(SavResView v);
+
+/* Check the type of the data in a (decoded) view; see
+ * savresDecodeTyped.
+ *
+ * RETURNS: 0 if they may be restored, -1 otherwise.
+ */
+int
+savresViewCheck(SavResView v, int type, unsigned long nelm, const char *nam);
+
+/* savresArchiveRstr of data which must hold 'nelm' elements
+ * of 'type' (see savresDecodeTyped).
+ */
+int
+savresArchiveRstrTyped(SavResArchive a, char *nam, char *buf, int n, int type, unsigned long nelm);
+
+/* Reverse the byte order of 'esz'-byte elements */
+void
+savresSwap(char *buf, unsigned long n, int esz);
+
+/* Open '<path>/<fnam>' for reading; a file in the flat layout
+ * is found (and moved) if hashed directories are used (see
+ * savresShardLevels).
+ *
+ * RETURNS: descriptor or -1 (errno set).
+ */
+int
+savresOpenData(char *path, char *fnam);
+
+/* savresArchiveDump with a header preceding the data */
+int
+savresArchiveDumpHdr(SavResArchive a, char *nam, char *hdr, int hlen, char *buf, int n, int durability);
+
+/* savresDeltaWrite for a file starting with a header of
+ * 'hlen' bytes which is rewritten, too.
+ */
+int
+savresDeltaWriteHdr(char *path, char *fnam, char *hdr, int hlen, char *buf, int n, SavResDelta d, int dosync);
+
+#ifndef NO_EPICS
+/* Asynchronous I/O (see savresAio.c). A job writes 'hlen'
+ * bytes of header and 'n' bytes of data to the (new, empty)
+ * file open on 'fd', flushes it if 'dosync' is set and
+ * closes it. The buffers must not be touched until the job
+ * is reaped.
+ */
+typedef struct SavResAioJobRec_ {
+	int                       fd;
+	const char               *hdr;
+	unsigned long             hlen;
+	const char               *buf;
+	unsigned long             n;
+	int                       dosync;
+	void                     *usr;
+	int                       status;  /* 0 or -1 once reaped */
+	int                       err;     /* errno if failed     */
+	/* private */
+	unsigned long             off;
+	int                       step;
+	struct SavResAioJobRec_  *next;
+} SavResAioJobRec, *SavResAioJob;
+
+typedef struct SavResAioRec_ *SavResAio;
+
+/* Create an engine for up to 'depth' jobs in flight. io_uring
+ * is used where the kernel supports it (unless 'nThreads' is
+ * negative); otherwise a pool of abs('nThreads') threads.
+ *
+ * RETURNS: engine or NULL.
+ */
+SavResAio
+savresAioCreate(const char *name, int depth, int nThreads, int priority);
+
+/* Start a job; the caller must not exceed 'depth' jobs in flight */
+void
+savresAioSubmit(SavResAio a, SavResAioJob j);
+
+/* Collect a finished job; wait for one if 'wait' is set (there
+ * must be a job in flight then).
+ *
+ * RETURNS: the job or NULL if none is finished.
+ */
+SavResAioJob
+savresAioReap(SavResAio a, int wait);
+
+/* RETURNS: name of the backend in use */
+const char *
+savresAioBackend(SavResAio a);
+
+/* Restore prefetching (see savresPrefetch.c) */
+typedef struct SavResPrefetchRec_ *SavResPrefetch;
+
+/* Read the files of all aao records in the database in
+ * '<path>' with 'nThreads' threads into a cache of 'size'
+ * bytes. Records for which 'skip' (may be NULL) returns
+ * nonzero are left out.
+ *
+ * RETURNS: prefetcher or NULL (nothing to do or failure).
+ */
+SavResPrefetch
+savresPrefetchStart(const char *path, int nThreads, unsigned long size, int priority, int (*skip)(const char *nam));
+
+/* Take the (decoded) data of 'nam' out of the cache; the
+ * caller must release the view with savresUnmapData.
+ *
+ * RETURNS: 0 on success, -1 if they are not cached (the
+ *          caller must read the file itself).
+ */
+int
+savresPrefetchGet(SavResPrefetch p, const char *nam, SavResView v);
+
+/* Stop the threads and release all cached data */
+void
+savresPrefetchStop(SavResPrefetch p);
+#endif
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
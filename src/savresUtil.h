@@ -1,26 +1,144 @@
 #ifndef SAVRES_HEADER_H
 #define SAVRES_HEADER_H
 
+#include <sys/uio.h>
+
+#ifndef NO_EPICS
 #include <epicsThread.h>
+#include <epicsTime.h>
 #include <aaoRecord.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Durability levels. Files are always written to a
+ * temporary file which then atomically replaces the
+ * old version, i.e., a crash never leaves a truncated
+ * file behind. The levels define whether the new data
+ * are also flushed to stable storage:
+ *
+ *  NONE:  no flushing; a power loss may lose the new
+ *         version (but not corrupt the old one).
+ *  BATCH: the asynchronous writer (aaoDumpDataAsync)
+ *         flushes all files written during one cycle
+ *         at once. savresDumpData treats this like SYNC.
+ *  SYNC:  every file is flushed individually.
+ */
+#define SAVRES_DURABLE_NONE   0
+#define SAVRES_DURABLE_BATCH  1
+#define SAVRES_DURABLE_SYNC   2
+
+/* global default; may be overridden per record
+ * (savresSetDurability).
+ */
+extern int savresDurability;
+
+/* Files of at least this many bytes (0: none, the default)
+ * bypass the page cache so that saving or restoring huge
+ * arrays doesn't evict everything else: they are written
+ * with O_DIRECT where the file system supports it and are
+ * otherwise flushed and dropped from the cache chunk by
+ * chunk (which implies syncing them). Restores hint the
+ * kernel to read ahead and drop the pages afterwards.
+ */
+extern int savresUncachedMin;
+
+/* Hashed directory layout. With N (1..SAVRES_SHARD_MAX)
+ * levels the file '<path>/<fnam>' lives in
+ * '<path>/xx/.../<fnam>' where each of the N 'xx' is a
+ * byte of the hash of 'fnam' in hex, so that no directory
+ * ever holds more than a few hundred entries. Missing
+ * subdirectories are created when a file is saved. Files
+ * saved in the flat layout (0 levels, the default) are
+ * still found by the restore routines and moved to their
+ * new place as they are read. Absolute names are never
+ * hashed. Set this before any file is saved or restored.
+ */
+#define SAVRES_SHARD_MAX 4
+extern int savresShardLevels;
+
 /* write 'n' bytes in 'buf' to a binary file.
  * File is created (permissions: current umask) if necessary.
  * 'path' may be omitted (NULL).
+ * The data are written to '<fnam>.tmp' which is then
+ * renamed to 'fnam'; unless 'savresDurability' is
+ * SAVRES_DURABLE_NONE the data are synced before.
  *
- * RETURNS: 0 on success, -1 on failure; an attempt is
- *          made to remove the file if the operation
- *          is unsuccessful.
+ * RETURNS: 0 on success, -1 on failure; the previous
+ *          contents of the file are preserved if the
+ *          operation is unsuccessful.
  */
 int
 savresDumpData(char *path, char *fnam, char *buf, int n);
 
+/* Compression. SAVRES_CODEC_SDLZ subtracts each element
+ * from its successor, regroups the bytes by their position
+ * within the element and compresses the result with a fast
+ * LZ77 coder. Works well for smooth curves and for sparse
+ * tables; data which do not shrink are stored raw.
+ * Compressed files carry a small header and are recognized
+ * (and uncompressed) by the restore routines automatically.
+ */
+#define SAVRES_CODEC_NONE     0
+#define SAVRES_CODEC_SDLZ     1
+
+/* global default for asynchronous saves; may be
+ * overridden per record (savresSetCodec).
+ */
+extern int savresCodec;
+
+/* Like savresDumpData but compress the data with 'codec'
+ * treating them as an array of 'esz'-byte elements (1, 2,
+ * 4 or 8; any other value is treated like 1). No header
+ * is written (see savresDumpDataTyped).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresDumpDataPacked(char *path, char *fnam, char *buf, int n, int codec, int esz);
+
+/* Element types recorded in the file header. These are
+ * independent of the DBF_xxx codes (which differ between
+ * EPICS versions) and of the host (e.g., a LONG always
+ * has 4 bytes).
+ */
+#define SAVRES_TYPE_RAW       0
+#define SAVRES_TYPE_STRING    1
+#define SAVRES_TYPE_CHAR      2
+#define SAVRES_TYPE_UCHAR     3
+#define SAVRES_TYPE_SHORT     4
+#define SAVRES_TYPE_USHORT    5
+#define SAVRES_TYPE_LONG      6
+#define SAVRES_TYPE_ULONG     7
+#define SAVRES_TYPE_FLOAT     8
+#define SAVRES_TYPE_DOUBLE    9
+#define SAVRES_TYPE_ENUM     10
+
+/* RETURNS: element size of a SAVRES_TYPE_xxx; 0 if unknown */
+int
+savresTypeSize(int type);
+
+/* Write 'nelm' elements of 'type' (SAVRES_TYPE_xxx) to
+ * a self-describing file, i.e., the data are preceded by
+ * a header recording the type, element size and count,
+ * the byte order of the writing host and a checksum.
+ * The data are compressed with 'codec' (see above).
+ * Such files are portable between architectures; the
+ * restore routines verify the checksum and convert the
+ * byte order if necessary.
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresDumpDataTyped(char *path, char *fnam, char *buf, int nelm, int type, int codec);
+
 /* read up to 'n' bytes from a binary file into 'buf'.
- * 'path' may be omitted (NULL).
+ * 'path' may be omitted (NULL). Compressed files are
+ * uncompressed. Files with a header (savresDumpDataTyped)
+ * are verified and converted to the host's byte order;
+ * files without are read as they are.
  *
  * RETURNS: number of bytes read (which may be less than n
  *          if file contains less data); -1 on failure.
@@ -28,6 +146,236 @@ savresDumpData(char *path, char *fnam, char *buf, int n);
 int
 savresRstrData(char *path, char *fnam, char *buf, int n);
 
+/* Vectored variants: the 'iovcnt' segments in 'iov' are
+ * saved to (restored from) one file back to back, e.g., a
+ * header and its payload or several arrays of a device,
+ * w/o copying them into a contiguous buffer first. Saving
+ * is atomic like savresDumpData, i.e., the file holds
+ * either all of the old or all of the new segments.
+ * Restoring fills the segments in order until they are
+ * full or the file ends. Raw files are read straight into
+ * the segments; files with a header or compressed data
+ * (savresDumpDataTyped) are decoded and then copied.
+ *
+ * RETURNS: savresDumpDataV: 0 on success, -1 on failure.
+ *          savresRstrDataV: number of bytes read; -1 on
+ *          failure.
+ */
+int
+savresDumpDataV(char *path, char *fnam, const struct iovec *iov, int iovcnt);
+
+int
+savresRstrDataV(char *path, char *fnam, const struct iovec *iov, int iovcnt);
+
+/* Incremental (delta) saves. A delta object keeps a hash
+ * of every SAVRES_DELTA_BLK bytes of the data which were
+ * last saved to a file. Saving identical data is then
+ * skipped altogether and otherwise only the blocks which
+ * changed are rewritten (in place).
+ * NOTE: Unlike savresDumpData, rewriting blocks in place
+ *       is not atomic; a crash during the update may leave
+ *       a mix of old and new blocks in the file.
+ */
+#define SAVRES_DELTA_BLK 4096
+
+typedef struct SavResDeltaRec_ *SavResDelta;
+
+/* Create a delta object for up to 'n' bytes.
+ * It starts out with no knowledge of the file.
+ *
+ * RETURNS: object or NULL (no memory).
+ */
+SavResDelta
+savresDeltaCreate(int n);
+
+void
+savresDeltaDestroy(SavResDelta d);
+
+/* Tell the object that the file holds exactly the 'n'
+ * bytes in 'buf' (e.g., after restoring).
+ */
+void
+savresDeltaSet(SavResDelta d, char *buf, int n);
+
+/* Forget what is known about the file */
+void
+savresDeltaInvalidate(SavResDelta d);
+
+/* Save 'n' bytes to '<path>/<fnam>' incrementally.
+ * Falls back to savresDumpData if nothing is known
+ * about the file or if it has the wrong size.
+ *
+ * RETURNS: 0 if data were written, 1 if the save was
+ *          skipped (data unchanged), -1 on failure.
+ */
+int
+savresDumpDataDelta(char *path, char *fnam, char *buf, int n, SavResDelta d);
+
+/* Lower-level steps of savresDumpDataDelta:
+ *
+ * savresDeltaCompare hashes 'buf' and returns the number
+ * of blocks which differ from the file (-1 if unknown).
+ * savresDeltaWrite rewrites these blocks in place (and
+ * syncs the file if 'dosync' is set); it returns 0 on
+ * success and -1 on failure (the object is invalidated
+ * in this case).
+ * savresDeltaCommit records that the data last passed
+ * to savresDeltaCompare are now in the file.
+ */
+int
+savresDeltaCompare(SavResDelta d, char *buf, int n);
+
+int
+savresDeltaWrite(char *path, char *fnam, char *buf, int n, SavResDelta d, int dosync);
+
+void
+savresDeltaCommit(SavResDelta d, int n);
+
+/* Read-only view of saved data. Where supported the
+ * file is mapped into memory (no copy); otherwise it
+ * is read into a buffer.
+ */
+typedef struct SavResViewRec_ {
+	const char    *data;   /* saved data (read-only) */
+	int            n;      /* number of bytes        */
+	/* private */
+	void          *base;
+	unsigned long  mlen;
+	int            mapped;
+	int            type;   /* from a header; RAW if none */
+	int            esz;
+	unsigned long  nelm;
+} SavResViewRec, *SavResView;
+
+/* Obtain a view of the file '<path>/<fnam>' ('path'
+ * may be NULL). The view must be released with
+ * savresUnmapData. The view holds the data only, i.e.,
+ * a header is skipped; compressed data or data of the
+ * wrong byte order are decoded into a buffer.
+ *
+ * RETURNS: number of bytes in the view or -1 on failure.
+ */
+int
+savresMapData(char *path, char *fnam, SavResView v);
+
+void
+savresUnmapData(SavResView v);
+
+/* Packed archive backend. Instead of one file per record
+ * a single, preallocated file holds a header, an index
+ * (name -> offset, length) and fixed, aligned data slots.
+ * Saving is a write into the record's slot, restoring
+ * needs no more than one open and one pass over the index
+ * (done by savresArchiveOpen).
+ * Every record has two data slots; a save updates the one
+ * which is not current and then switches over, i.e., the
+ * previous version survives a crash.
+ */
+typedef struct SavResArchiveRec_ *SavResArchive;
+
+/* Open the archive '<path>/<fnam>' ('path' may be NULL and
+ * is ignored if 'fnam' is absolute). A new archive with
+ * room for 'maxEntries' records and a total size of
+ * 'sizeMB' megabytes is created if the file does not exist;
+ * otherwise these parameters are ignored.
+ *
+ * RETURNS: archive handle or NULL on failure.
+ */
+SavResArchive
+savresArchiveOpen(char *path, char *fnam, int maxEntries, int sizeMB);
+
+void
+savresArchiveClose(SavResArchive a);
+
+/* Save 'n' bytes under 'nam', allocating a new slot if
+ * necessary. 'durability' is one of the SAVRES_DURABLE_xxx
+ * levels. With SAVRES_DURABLE_BATCH the data are written but
+ * the new version only becomes current once the caller has
+ * flushed the archive (savresArchiveSync) and then called
+ * savresArchiveCommit. This allows many records to be
+ * flushed at once (call savresArchiveSync again after the
+ * commits to make these durable, too).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresArchiveDump(SavResArchive a, char *nam, char *buf, int n, int durability);
+
+int
+savresArchiveCommit(SavResArchive a, char *nam);
+
+int
+savresArchiveSync(SavResArchive a);
+
+/* Read up to 'n' bytes saved under 'nam' into 'buf'
+ * (decoded like savresRstrData).
+ * 
+ * RETURNS: number of bytes read; -1 if there is no
+ *          (valid) data for 'nam'.
+ */
+int
+savresArchiveRstr(SavResArchive a, char *nam, char *buf, int n);
+
+/* Obtain a read-only view of the current data saved
+ * under 'nam' (see savresMapData). The view must be
+ * released with savresUnmapData.
+ *
+ * RETURNS: number of bytes in the view or -1 if there
+ *          is no (valid) data for 'nam'.
+ */
+int
+savresArchiveMap(SavResArchive a, char *nam, SavResView v);
+
+/* Handles for files which are saved over and over again.
+ * A handle holds a descriptor of the directory (names are
+ * resolved relative to it where openat is supported) and
+ * the precomputed file names so that saving involves no
+ * allocations or path lookups.
+ *
+ * With SAVRES_HANDLE_KEEPOPEN the file itself is kept open
+ * and every save is a single write at offset 0 (the file is
+ * only truncated if its length changes). Such saves are
+ * flushed unless 'savresDurability' is SAVRES_DURABLE_NONE.
+ * NOTE: Like delta saves, rewriting a kept-open file is not
+ *       atomic; a crash may leave a mix of old and new data.
+ * Otherwise saving is atomic like savresDumpData.
+ */
+typedef struct SavResHandleRec_ *SavResHandle;
+
+#define SAVRES_HANDLE_KEEPOPEN 1
+
+/* Create a handle for '<path>/<fnam>' ('path' may be NULL).
+ * With SAVRES_HANDLE_KEEPOPEN the file is created if it
+ * doesn't exist yet.
+ *
+ * RETURNS: handle or NULL on failure.
+ */
+SavResHandle
+savresHandleCreate(char *path, char *fnam, int flags);
+
+void
+savresHandleDestroy(SavResHandle h);
+
+/* Save 'n' bytes in 'buf' (segments in 'iov'); see
+ * savresDumpData (savresDumpDataV).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresHandleDump(SavResHandle h, char *buf, int n);
+
+int
+savresHandleDumpV(SavResHandle h, const struct iovec *iov, int iovcnt);
+
+/* Read up to 'n' bytes into 'buf'; see savresRstrData.
+ *
+ * RETURNS: number of bytes read; -1 on failure.
+ */
+int
+savresHandleRstr(SavResHandle h, char *buf, int n);
+
+#ifndef NO_EPICS
+
 /* Notify a helper thread to dump the aao data
  * to a file. Can be called by aao record processing
  * (devsup 'write_aao').
@@ -39,6 +387,22 @@ savresRstrData(char *path, char *fnam, char *buf, int n);
  * ie., the 'last' job will succeed. There is no
  * control over when the write is actually performed.
  * (AAO doesn't allow for async record processing :-( )
+ * Requests for a record which is still waiting to be
+ * written are coalesced, i.e., a record is queued at
+ * most once and the helper writes the most recent
+ * contents.
+ * Unless the 'savresSnapshot' variable is set to zero
+ * the array is copied into a preallocated buffer by
+ * this routine (which must thus be called with the
+ * record locked, e.g., from 'write_aao'); the helper
+ * only writes such consistent snapshots.
+ * This routine never blocks; if the queue (size set
+ * by the 'savresQueueDepth' variable) is full then
+ * the record is set aside and retried by the helper
+ * once the queue has drained. Such overflows are
+ * counted in 'aaoSavResOverflows'.
+ * Files are written with a header (see
+ * savresDumpDataTyped).
  * 
  * RETURNS: 0 on successful job queuing, -1 if queuing
  *          the job failed.
@@ -56,11 +420,22 @@ aaoDumpDataAsync(struct aaoRecord *paao);
  * set.
  * This is usually called by 'init_record_aao' (devsup)
  * and hence it is OK to be synchronous.
+ * Files of another byte order are converted. Old files
+ * (w/o header) of LONG/ULONG records written by a host
+ * with 8-byte longs are converted, too.
+ * Files with a header which hold another type than the
+ * record's FTVL are not restored (the record stays UDF);
+ * if the number of elements differs from NELM a message
+ * is logged and the shorter length is restored.
  * 
  * RETURNS: 0 on success, -1 on failure.
  *
  * NOTE: paao->udf is set to FALSE and alarms are
  *       reset on success.
+ *
+ * NOTE: Records configured with savresSetDeferredRestore
+ *       are only marked UDF/INVALID (and 0 is returned);
+ *       their data are restored once iocInit is done.
  */
 int
 aaoRstrData(struct aaoRecord *paao);
@@ -75,11 +450,195 @@ aaoRstrData(struct aaoRecord *paao);
  * routines (savresDumpData/saveresRstrData) are
  * used.
  *
- * Creates an epics message queue and a thread.
+ * Creates the submission queues and writer threads
+ * (see savresWriterConfig).
  */
 int 
 aaoSavResInit();
 
+/* Configure the pool of writer threads. Every record
+ * is always written by the same thread (hashed by
+ * name) so that its saves remain ordered while
+ * different records are written in parallel.
+ * 'nThreads' (default 1, max. 32) must be set before
+ * aaoSavResInit, i.e., before iocInit. The priority
+ * (default: epicsThreadPriorityLow) may be changed at
+ * any time. Pass 0 to leave a parameter unchanged.
+ * (Also available from iocsh.)
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresWriterConfig(int nThreads, int priority);
+
+/* Write the files of a batch asynchronously, i.e., with up
+ * to 'depth' (max. 32; 0 disables, which is the default)
+ * files in flight per writer. io_uring is used where the
+ * kernel supports it, a pool of 'nThreads' (default 4)
+ * threads per writer otherwise; a negative 'nThreads'
+ * forces the thread pool. Does not apply to the archive
+ * (savresArchiveConfig). Must be called before iocInit
+ * (also available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresAioConfig(int depth, int nThreads);
+
+/* Prefetch the files restored by aaoRstrData. When iocInit
+ * starts, 'nThreads' threads (0 disables, which is the
+ * default) read the files of all aao records in parallel
+ * into a cache of 'cacheMB' megabytes (default 64) so that
+ * restoring a record merely copies the data; the cache is
+ * released once the records are initialized. Records whose
+ * file is not cached (yet) read it themselves. Not used with
+ * the archive (savresArchiveConfig). Must be called before
+ * iocInit (also available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresPrefetchConfig(int nThreads, int cacheMB);
+
+/* Use the archive '<DATA_PATH>/<fnam>' (see savresArchiveOpen)
+ * rather than one file per record for asynchronous saves
+ * and for aaoRstrData. Records which are not found in the
+ * archive are still restored from their individual file.
+ * Must be called before iocInit (also available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresArchiveConfig(char *fnam, int maxEntries, int sizeMB);
+#endif
+
+/* Set the durability level (SAVRES_DURABLE_xxx) of a
+ * record's asynchronous saves. If 'recName' is NULL
+ * or empty then the global default is set.
+ * May be called before or after iocInit (also
+ * available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetDurability(const char *recName, int level);
+
+/* Enable ('on' != 0) or disable incremental saves
+ * (see savresDumpDataDelta) for a record's asynchronous
+ * saves. If 'recName' is NULL or empty then the global
+ * default ('savresDelta' variable) is set. When enabled,
+ * unchanged data are not saved again and only changed
+ * blocks are rewritten (in place, i.e., not atomically
+ * w.r.t. a crash). Has no effect if snapshots are
+ * disabled; with an archive only unchanged saves are
+ * skipped.
+ * May be called before or after iocInit (also
+ * available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetDelta(const char *recName, int on);
+
+/* Select the compression (SAVRES_CODEC_xxx) of a record's
+ * asynchronous saves; the element size is given by the
+ * record's FTVL. If 'recName' is NULL or empty then the
+ * global default is set. Compressed saves are never done
+ * in place (see savresSetDelta) but unchanged data are
+ * still skipped.
+ * May be called before or after iocInit (also
+ * available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetCodec(const char *recName, int codec);
+
+/* Save a record at most every 'seconds' seconds. Requests
+ * arriving earlier are deferred (not dropped), i.e., the
+ * most recent data are saved once the interval has expired.
+ * If 'recName' is NULL or empty then the global default
+ * ('savresMinInterval' variable; 0: no limit) is set.
+ * May be called before or after iocInit (also
+ * available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetMinInterval(const char *recName, double seconds);
+
+/* Defer the restore of a (big) record until iocInit is done
+ * so that it doesn't hold up booting the IOC. aaoRstrData
+ * leaves the record UDF/INVALID; a thread restores the
+ * deferred records one after another, lowest 'order' first,
+ * and then resets the alarms and posts the data. Saves of
+ * the record are held back until its data are restored; a
+ * record that is processed before its turn comes is not
+ * restored (its new data are more recent than the file)
+ * but saved. A negative 'order' restores the record during
+ * iocInit (the default). Must be called before iocInit
+ * (also available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetDeferredRestore(const char *recName, int order);
+
+/* Limit the bandwidth used by all asynchronous saves
+ * together to 'bytesPerSec' (0: unlimited; also available
+ * as the 'savresBandwidth' variable). Writers which exceed
+ * the budget are delayed. May be changed at any time
+ * (also available from iocsh).
+ *
+ * RETURNS: 0 on success, -1 on failure.
+ */
+int
+savresSetBandwidth(int bytesPerSec);
+
+#ifndef NO_EPICS
+/* Statistics of asynchronous saves (per record or totals).
+ * Times are in milliseconds. The write latency histogram
+ * has bins [0, 1), [1, 2), [2, 4), ... ms; the last bin
+ * holds everything above.
+ */
+#define SAVRES_STAT_BINS 16
+
+typedef struct SavResStatsRec_ {
+	unsigned long  submits;    /* aaoDumpDataAsync calls              */
+	unsigned long  coalesced;  /* ... merged with a pending request   */
+	unsigned long  overflows;  /* ... which found the queue full      */
+	unsigned long  dropped;    /* ... which were lost (totals only)   */
+	unsigned long  saves;      /* successful writes                   */
+	unsigned long  skipped;    /* unchanged data (see savresSetDelta) */
+	unsigned long  errors;     /* failed writes                       */
+	double         bytes;      /* bytes written                       */
+	double         waitSum;    /* time from request to writer         */
+	double         waitMax;
+	double         latSum;     /* time spent writing                  */
+	double         latMax;
+	unsigned long  lat[SAVRES_STAT_BINS];
+	int            lastErrno;
+	epicsTimeStamp lastError;
+	epicsTimeStamp lastSuccess;  /* data became visible (or were
+	                              * found unchanged)          */
+} SavResStatsRec, *SavResStats;
+
+/* Obtain the statistics of a record or the totals (if
+ * 'recName' is NULL or empty).
+ *
+ * RETURNS: 0 on success, -1 if the record is unknown.
+ */
+int
+savresGetStats(const char *recName, SavResStats s);
+
+/* Print statistics (level 0: totals, 1: per record,
+ * 2: with latency histograms). Also available from
+ * iocsh.
+ */
+void
+savresReport(int level);
+#endif
+
 #ifdef __cplusplus
 };
 #endif
@@ -33,6 +33,36 @@ io16_le(TYPE_16 *addr, TYPE_16 val)
 	return in_le16(addr);
 }
 
+__TillsIoOps64_t
+io64_be(__TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	out_be64(addr,val);
+	return in_be64(addr);
+}
+
+__TillsIoOps64_t
+io64_le(__TillsIoOps64_t *addr, __TillsIoOps64_t val)
+{
+	out_le64(addr,val);
+	return in_le64(addr);
+}
+
+int
+io32_be_block(TYPE_32 *dev, TYPE_32 *buf, int n)
+{
+TYPE_32	tmp[64];
+int		i;
+	if (n < 0 || n > sizeof(tmp)/sizeof(tmp[0]))
+		return -1;
+	out_be32_block(dev, buf, n);
+	in_be32_block(dev, tmp, n);
+	for (i=0; i<n; i++) {
+		if (tmp[i] != buf[i] || dev[i] != htonl(buf[i]))
+			return -1;
+	}
+	return 0;
+}
+
 unsigned char
 io8(unsigned char *addr, unsigned char val)
 {
@@ -75,6 +105,8 @@ int	isbig;
 TYPE_32		i=0xdeadbeef, res32, out32;
 TYPE_16		s=0xcafe,     res16, out16;
 unsigned char	c=0xf0,       res8,  out8;
+TYPE_32		blk32[37], dev32[37];
+__TillsIoOps64_t	l=0x0123456789abcdefULL, res64, out64;
 
 	etest.i = 1;
 
@@ -118,6 +150,23 @@ unsigned char	c=0xf0,       res8,  out8;
 
 	printf("\n");
 
+	res64 = io64_be(&out64,l);
+	printf("Writing BE 0x%016llx: first byte 0x%02x, read back 0x%016llx\n", (unsigned long long)l, *(unsigned char*)&out64, (unsigned long long)res64);
+	printf("  expected 0x%016llx: first byte 0x%02x, read back 0x%016llx\n", (unsigned long long)l, (unsigned)(l>>56), (unsigned long long)l);
+
+	printf("\n");
+
+	res64 = io64_le(&out64,l);
+	printf("Writing LE 0x%016llx: first byte 0x%02x, read back 0x%016llx\n", (unsigned long long)l, *(unsigned char*)&out64, (unsigned long long)res64);
+	printf("  expected 0x%016llx: first byte 0x%02x, read back 0x%016llx\n", (unsigned long long)l, (unsigned)(l&0xff), (unsigned long long)l);
+
+	printf("\n");
+
+	for (res32=0; res32<sizeof(blk32)/sizeof(blk32[0]); res32++)
+		blk32[res32] = i + res32;
+	printf("Writing BE block of %u: %s\n\n", (unsigned)(sizeof(blk32)/sizeof(blk32[0])),
+		io32_be_block(dev32, blk32, sizeof(blk32)/sizeof(blk32[0])) ? "FAILED" : "OK");
+
 	res8  = io8(&out8,c);
 	printf("Writing BYTE 0x%02x: 0x%02x, read back 0x%02x\n", c, out8, res8);
 	printf("  expected   0x%02x: 0x%02x, read back 0x%02x\n", c, out8, res8);